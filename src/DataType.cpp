@@ -105,7 +105,7 @@ namespace {
     template <class T>
         class PrimaryType: public DataType {
             public:
-                PrimaryType(): DataType(sizeof(T), setValue) {
+                PrimaryType(): DataType(sizeof(T), setValue, getValue) {
                 }
 
             private:
@@ -139,6 +139,10 @@ namespace {
                     *reinterpret_cast<T*>(dst) = static_cast<T>(src);
                     dst += sizeof(T);
                 }
+
+                static double getValue(const char *src) {
+                    return *reinterpret_cast<const T*>(src);
+                }
         };
 
     template<>
@@ -214,19 +218,21 @@ DataType::Field::Field (const std::string& name, const DataType& type,
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 DataType::DataType (const std::string& name, size_t size):
-    name(name), size(size), setValue(0)
+    name(name), size(size), setValue(0), getValue(0)
 {
 }
 
 //////////////////////////////////////////////////////////////////////
 DataType::DataType (const DataType& other):
-    name(other.name), size(other.size), setValue(other.setValue)
+    name(other.name), size(other.size), setValue(other.setValue),
+    getValue(other.getValue)
 {
 }
 
 //////////////////////////////////////////////////////////////////////
-DataType::DataType (size_t size, void (*setValue)(char *&, double )):
-    size(size), setValue(setValue)
+DataType::DataType (size_t size, void (*setValue)(char *&, double ),
+        double (*getValue)(const char *)):
+    size(size), setValue(setValue), getValue(getValue)
 {
 }
 
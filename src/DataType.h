@@ -100,6 +100,7 @@ class DataType {
         bool operator==(const DataType& other) const;
         bool operator!=(const DataType& other) const;
         void (* const setValue)(char *&, double);
+        double (* const getValue)(const char *);
 
         static const DataType& boolean;
         static const DataType&   uint8;
@@ -173,7 +174,8 @@ class DataType {
 
     protected:
         DataType(const DataType& other);
-        explicit DataType(size_t size, void (*)(char *&dst, double src));
+        explicit DataType(size_t size, void (*)(char *&dst, double src),
+                double (*)(const char *src));
 
     private:
 
@@ -72,6 +72,7 @@ Main::Main(const std::string& name, const std::string& version):
     eventLog(log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("event")))
 {
     msrproto = 0;
+    parameterGeneration = 0;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -175,6 +176,11 @@ void Main::startServers()
     LOG4CPLUS_INFO_STR(log4cplus::Logger::getRoot(),
             LOG4CPLUS_TEXT("Starting servers"));
 
+    // Take over the initial parameter values
+    for (std::list<const Parameter*> params(getParameters());
+            params.size(); params.pop_front())
+        commit(static_cast<const ProcessParameter*>(params.front()));
+
     msrproto   = new   MsrProto::Server(this, config("msr"));
 
 //    EtlProto::Server etlproto(this);
@@ -191,6 +197,26 @@ void Main::stopServers()
             LOG4CPLUS_TEXT("Shut down servers"));
 }
 
+/////////////////////////////////////////////////////////////////////////////
+unsigned int Main::getParameterGeneration() const
+{
+    return parameterGeneration;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Main::commit(const ProcessParameter *p)
+{
+    ost::MutexLock lock(parameterMutex);
+
+    parameterGeneration = parameterGeneration + 1;
+    __sync_synchronize();
+
+    p->commit(parameterGeneration + 1);
+
+    __sync_synchronize();
+    parameterGeneration = parameterGeneration + 1;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 int Main::setValue(const ProcessParameter* p, const Session* /*session*/,
         const char* buf, size_t offset, size_t count)
@@ -200,6 +226,8 @@ int Main::setValue(const ProcessParameter* p, const Session* /*session*/,
     if (rv)
         return rv;
 
+    commit(p);
+
     msrproto->parameterChanged(p, offset, count);
 
     PersistentMap::iterator it = persistentMap.find(p);
@@ -502,6 +530,11 @@ void Main::newEvent(Event* event,
     eventPtr->index = index;
     eventPtr->state = state;
     eventPtr->time = *time;
+
+    // Sessions are informed by the protocol server
+    if (msrproto)
+        msrproto->newEvent(*eventPtr);
+
     if (++eventPtr == eventList.end())
         eventPtr = eventList.begin();
 
@@ -546,38 +579,18 @@ void Main::newEvent(Event* event,
 }
 
 /////////////////////////////////////////////////////////////////////////////
-EventData Main::getNextEvent(Session* session) const
-{
-    ost::ReadLock lock(eventMutex);
-
-    if (session->eventId >= eventList.size())
-        session->eventId = eventPtr - eventList.begin();
-
-    if (ssize_t(session->eventId) == eventPtr - eventList.begin()) {
-        static const EventData d;
-        return d;
-    }
-
-    const EventData& eventData = eventList[session->eventId];
-    if (++session->eventId == eventList.size())
-        session->eventId = 0;
-
-    return eventData;
-}
-
-/////////////////////////////////////////////////////////////////////////////
-std::list<EventData> Main::getEventHistory(Session* session) const
+std::list<EventData> Main::getEventHistory() const
 {
     ost::ReadLock lock(eventMutex);
     std::list<EventData> list;
+    std::vector<EventData>::const_iterator end = eventPtr;
     std::vector<EventData>::const_iterator it =
-        eventPtr->event ? eventPtr : eventList.begin();
+        eventPtr->event ? end : eventList.begin();
 
-    if ( it >= eventPtr)
+    if ( it >= end)
         list.insert(list.end(), it, eventList.end());
 
-    list.insert(list.end(),
-            eventList.begin(), eventList.begin() + session->eventId);
+    list.insert(list.end(), eventList.begin(), end);
 
     return list;
 }
@@ -86,8 +86,7 @@ class Main {
         virtual void prepare(Session *session) const = 0;
         virtual void cleanup(const Session *session) const = 0;
 
-        EventData getNextEvent(Session* session) const;
-        std::list<EventData> getEventHistory(Session* session) const;
+        std::list<EventData> getEventHistory() const;
 
         // Setting a parameter has various steps:
         // 1) client calls parameter->setValue(session, ...)
@@ -103,6 +102,15 @@ class Main {
         int setValue(const ProcessParameter* p, const Session *session,
                 const char* buf, size_t offset, size_t count);
 
+        // Parameter generation. It is incremented before and after
+        // a changed parameter is committed, so it is odd while a commit
+        // is in progress. Reading the same even generation before and
+        // after reading several parameters means that the values are
+        // a consistent snapshot.
+        // Every parameter remembers the generation after its last change,
+        // see ProcessParameter::getGeneration()
+        unsigned int getParameterGeneration() const;
+
     protected:
         void setupLogging();
 
@@ -126,6 +134,10 @@ class Main {
                 const char* buf, size_t offset, size_t count) = 0;
 
     private:
+        volatile unsigned int parameterGeneration;
+        ost::Mutex parameterMutex;      // Serializes commits
+        void commit(const ProcessParameter *p);
+
         std::vector<EventData> eventList;
         std::vector<EventData>::iterator eventPtr;
         mutable ost::ThreadLock eventMutex;
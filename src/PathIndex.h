@@ -0,0 +1,138 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef PATHINDEX_H
+#define PATHINDEX_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+
+namespace PdServ {
+
+/* Hash index from a name (path or alias) to an object.
+ *
+ * The index is filled once during startup using insert() and is read only
+ * afterwards, so that any number of threads may use find() concurrently
+ * without locking. Lookups neither allocate memory nor compare more than
+ * the key that matches the hash.
+ *
+ * Keys are kept together in a single string, the table is open addressed
+ * using linear probing and at most half full.
+ */
+template <class T>
+class PathIndex {
+    public:
+        PathIndex(): count(0) {
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        // Returns false if the key exists already, in which case the first
+        // entry is kept
+        bool insert(const std::string& key, T* value) {
+            if (2 * (count + 1) > table.size())
+                rehash(table.empty() ? 64 : 2 * table.size());
+
+            uint32_t h = hash(key.data(), key.size());
+            Entry* e = lookup(key.data(), key.size(), h);
+            if (e->value)
+                return false;
+
+            e->hash = h;
+            e->keyOffset = keys.size();
+            e->keyLength = key.size();
+            e->value = value;
+            keys.append(key);
+            ++count;
+
+            return true;
+        }
+
+        // Returns 0 if the key does not exist
+        T* find(const char* key, size_t len) const {
+            return table.empty()
+                ? 0 : lookup(key, len, hash(key, len))->value;
+        }
+
+        T* find(const std::string& key) const {
+            return find(key.data(), key.size());
+        }
+
+    private:
+        struct Entry {
+            uint32_t hash;
+            uint32_t keyOffset;
+            uint32_t keyLength;
+            T* value;
+        };
+
+        typedef std::vector<Entry> Table;
+        Table table;
+        std::string keys;
+        size_t count;
+
+        // FNV-1a
+        static uint32_t hash(const char* s, size_t len) {
+            uint32_t h = 2166136261U;
+            while (len--)
+                h = (h ^ static_cast<unsigned char>(*s++)) * 16777619U;
+            return h;
+        }
+
+        // Return the entry for key, or the empty entry where it belongs
+        Entry* lookup(const char* key, size_t len, uint32_t h) const {
+            const size_t mask = table.size() - 1;
+            for (size_t i = h & mask; ; i = (i + 1) & mask) {
+                const Entry& e = table[i];
+                if (!e.value or (e.hash == h and e.keyLength == len
+                            and !::memcmp(keys.data() + e.keyOffset,
+                                key, len)))
+                    return const_cast<Entry*>(&e);
+            }
+        }
+
+        void rehash(size_t n) {
+            Table old(n);
+            old.swap(table);
+
+            for (typename Table::const_iterator it = old.begin();
+                    it != old.end(); ++it) {
+                if (!it->value)
+                    continue;
+
+                const size_t mask = table.size() - 1;
+                size_t i = it->hash & mask;
+                while (table[i].value)
+                    i = (i + 1) & mask;
+                table[i] = *it;
+            }
+        }
+};
+
+}
+
+#endif //PATHINDEX_H
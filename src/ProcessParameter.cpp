@@ -39,15 +39,26 @@ ProcessParameter::ProcessParameter(
         size_t ndims,
         const size_t *dim):
     Parameter(path, mode, dtype, ndims, dim),
-    main(main), valueBuf(addr), mtime(mtime)
+    main(main), valueBuf(addr), mtime(mtime), value(new char[memSize])
 {
+    std::fill_n(value, memSize, 0);
+    valueTime.tv_sec = 0;
+    valueTime.tv_nsec = 0;
+    seq = 0;
+    generation = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+ProcessParameter::~ProcessParameter()
+{
+    delete[] value;
 }
 
 //////////////////////////////////////////////////////////////////////
 int ProcessParameter::setValue(const PdServ::Session* session,
         const char *buf, size_t offset, size_t count) const
 {
-    ost::WriteLock lock(mutex);
+    ost::MutexLock lock(mutex);
 
     return main->setValue(this, session, buf, offset, count);
 }
@@ -56,13 +67,37 @@ int ProcessParameter::setValue(const PdServ::Session* session,
 int ProcessParameter::getValue(const PdServ::Session* /*session*/,
         void* buf,  struct timespec *time) const
 {
-    ost::ReadLock lock(mutex);
+    unsigned int s;
 
-    copyValue(buf, time);
+    // Retry when the value was committed while being copied
+    do {
+        while ((s = seq) & 1)
+            ost::Thread::yield();
+        __sync_synchronize();
+
+        std::copy(value, value + memSize, reinterpret_cast<char*>(buf));
+        if (time)
+            *time = valueTime;
+
+        __sync_synchronize();
+    } while (s != seq);
 
     return 0;
 }
 
+//////////////////////////////////////////////////////////////////////
+void ProcessParameter::commit(unsigned int generation) const
+{
+    seq = seq + 1;
+    __sync_synchronize();
+
+    copyValue(value, &valueTime);
+    this->generation = generation;
+
+    __sync_synchronize();
+    seq = seq + 1;
+}
+
 //////////////////////////////////////////////////////////////////////
 void ProcessParameter::copyValue(void* buf, struct timespec* time) const
 {
@@ -71,6 +106,12 @@ void ProcessParameter::copyValue(void* buf, struct timespec* time) const
         *time = *mtime;
 }
 
+//////////////////////////////////////////////////////////////////////
+unsigned int ProcessParameter::getGeneration() const
+{
+    return generation;
+}
+
 //////////////////////////////////////////////////////////////////////
 void ProcessParameter::print(
         std::ostream& os, size_t offset, size_t count) const
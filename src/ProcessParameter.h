@@ -44,16 +44,35 @@ class ProcessParameter: public Parameter {
                 size_t ndims = 1,
                 const size_t *dim = 0);
 
+        ~ProcessParameter();
+
         void print(std::ostream& os, size_t offset, size_t count) const;
+
+        // Copy the value of the process
         void copyValue(void* buf, struct timespec*) const;
 
+        // Take over the value of the process for getValue(). Called by
+        // Main after the value has changed
+        void commit(unsigned int generation) const;
+
+        // Parameter generation of the last commit
+        // (see Main::getParameterGeneration())
+        unsigned int getGeneration() const;
+
     private:
         Main* const main;
 
         const char* const* const valueBuf;
         const struct timespec* const mtime;
 
-        mutable ost::ThreadLock mutex;
+        // Serializes writers. Readers do not lock, they read a copy of
+        // the value that is protected by a sequence counter
+        mutable ost::Mutex mutex;
+
+        char * const value;
+        mutable struct timespec valueTime;
+        mutable volatile unsigned int seq;     // Odd while committing
+        mutable volatile unsigned int generation;
 
         // Reimplemented from PdServ::Parameter
         int setValue(const PdServ::Session* session,
@@ -22,11 +22,13 @@
  *****************************************************************************/
 
 #include "Session.h"
+#include "SharedBuffer.h"
 #include "Main.h"
 #include "Debug.h"
 
 #include <cerrno>
 #include <cstring>      // strerror()
+#include <sys/uio.h>    // struct iovec
 #include <log4cplus/logger.h>
 #include <log4cplus/loggingmacros.h>
 
@@ -35,26 +37,41 @@
 #    include "TLS.h"
 #endif
 
+#ifdef ZLIB_FOUND
+#    include <zlib.h>
+#endif
+
 using namespace PdServ;
 
 /////////////////////////////////////////////////////////////////////////////
 Session::Session(const Main *m, log4cplus::Logger& log, size_t bufsize)
-: main(m), log(log)
+: main(m), log(log), bufsize(bufsize)
 {
     p_eof = false;
     state = NoTLS;
 
+    queued = 0;
+    queuedMax = 0;
+
+    zstream = 0;
+    zNext = 0;
+    zBuffer = 0;
+    zPtr = 0;
+    zPending = false;
+    compressIn = 0;
+    compressOut = 0;
+    compressTime = 0.0;
+
 #ifdef GNUTLS_FOUND
     tls_session = 0;
+    tlsRetryLength = 0;
 #endif
 
     main->gettime(&connectedTime);
     main->prepare(this);
-    eventId = ~0U;
-    main->getNextEvent(this);
 
-    char* buf = new char[bufsize];
-    setp(buf, buf + bufsize);
+    putBuffer = 0;
+    newPutArea();
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -66,7 +83,27 @@ Session::~Session()
 #endif
 
     main->cleanup(this);
-    delete[] pbase();
+
+#ifdef ZLIB_FOUND
+    if (zstream) {
+        deflateEnd(zstream);
+        delete zstream;
+        zBuffer->unref();
+    }
+
+    if (zNext) {
+        deflateEnd(zNext);
+        delete zNext;
+    }
+#endif
+
+    for (; !outputQueue.empty(); outputQueue.pop_front())
+        outputQueue.front().buffer->unref();
+
+    for (; !spareBuffers.empty(); spareBuffers.pop_back())
+        spareBuffers.back()->unref();
+
+    putBuffer->unref();
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -103,12 +140,197 @@ int Session::startTLS()
 #endif
 }
 
+/////////////////////////////////////////////////////////////////////////////
+int Session::startCompression(int level)
+{
+#ifdef ZLIB_FOUND
+    if (zstream or zNext)
+        return -EALREADY;
+
+    // The stream takes over in flush(), so that the caller can still
+    // send an uncompressed reply
+    zNext = new z_stream;
+    zNext->zalloc = Z_NULL;
+    zNext->zfree = Z_NULL;
+    zNext->opaque = Z_NULL;
+
+    int result = deflateInit(zNext, level);
+    if (result != Z_OK) {
+        LOG4CPLUS_ERROR(log,
+                LOG4CPLUS_TEXT("deflateInit() failed: ")
+                << LOG4CPLUS_C_STR_TO_TSTRING(zError(result)));
+        delete zNext;
+        zNext = 0;
+        return result;
+    }
+
+    return 0;
+#else
+    (void)level;
+    return -1;
+#endif
+}
+
 /////////////////////////////////////////////////////////////////////////////
 bool Session::eof() const
 {
     return p_eof;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+size_t Session::queuedBytes() const
+{
+    return queued + (pptr() - pbase());
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Session::queue(SharedBuffer* buffer, const char* begin, const char* end)
+{
+    // Keep the order of the data
+    closePutArea();
+
+    if (zstream)
+        compress(begin, end, false);
+    else
+        append(buffer, begin, end);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Append [begin, end) of buffer to the output queue
+void Session::append(SharedBuffer* buffer, const char* begin, const char* end)
+{
+    if (begin == end)
+        return;
+
+    // Extend the last chunk if the data is contiguous
+    if (!outputQueue.empty() and outputQueue.back().buffer == buffer
+            and outputQueue.back().end == begin)
+        outputQueue.back().end = end;
+    else {
+        Chunk chunk = {buffer->ref(), begin, end};
+        outputQueue.push_back(chunk);
+    }
+
+    queued += end - begin;
+    queuedMax = std::max(queued, queuedMax);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Append the data in the put area to the output queue. The remaining
+// space of putBuffer stays available as put area
+void Session::closePutArea()
+{
+    if (pptr() == pbase())
+        return;
+
+    if (zstream) {
+        // The data was copied by the compressor, so that the put area
+        // can be reused
+        compress(pbase(), pptr(), false);
+        setp(pbase(), epptr());
+    }
+    else {
+        append(putBuffer, pbase(), pptr());
+        setp(pptr(), epptr());
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Pass [begin, end) through the compressor, appending its output to the
+// output queue. When sync is set, all pending output is flushed to a
+// byte boundary (Z_SYNC_FLUSH), so that the client can decompress
+// everything it has received up to here.
+void Session::compress(const char* begin, const char* end, bool sync)
+{
+#ifdef ZLIB_FOUND
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+
+    zstream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(begin));
+    zstream->avail_in = end - begin;
+
+    do {
+        if (zPtr == zBuffer->end()) {
+            zBuffer->unref();
+            zBuffer = newBuffer();
+            zPtr = zBuffer->begin();
+        }
+
+        zstream->next_out = reinterpret_cast<Bytef*>(zPtr);
+        zstream->avail_out = zBuffer->end() - zPtr;
+
+        deflate(zstream, sync ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+
+        char* p = reinterpret_cast<char*>(zstream->next_out);
+        append(zBuffer, zPtr, p);
+        zPtr = p;
+
+    } while (!zstream->avail_out);
+
+    zPending = !sync;
+    compressIn = zstream->total_in;
+    compressOut = zstream->total_out;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+    compressTime += (t1.tv_sec - t0.tv_sec)
+        + (t1.tv_nsec - t0.tv_nsec) * 1.0e-9;
+#else
+    (void)begin;
+    (void)end;
+    (void)sync;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Session::newPutArea()
+{
+    if (putBuffer)
+        putBuffer->unref();
+
+    putBuffer = newBuffer();
+    setp(putBuffer->begin(), putBuffer->end());
+}
+
+/////////////////////////////////////////////////////////////////////////////
+SharedBuffer* Session::newBuffer()
+{
+    if (spareBuffers.empty())
+        return SharedBuffer::create(bufsize);
+
+    SharedBuffer* buffer = spareBuffers.back();
+    spareBuffers.pop_back();
+    return buffer;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Remove count bytes from the front of the output queue
+void Session::consume(size_t count)
+{
+    queued -= count;
+
+    while (count) {
+        Chunk& chunk = outputQueue.front();
+        size_t n = std::min(count, size_t(chunk.end - chunk.begin));
+
+        chunk.begin += n;
+        count -= n;
+
+        if (chunk.begin != chunk.end)
+            break;
+
+        // Keep a few buffers that are not used any more so that
+        // they can be recycled
+        SharedBuffer* buffer = chunk.buffer;
+        if (buffer->unique() and buffer != putBuffer and buffer != zBuffer
+                and buffer->size == bufsize and spareBuffers.size() < 4)
+            spareBuffers.push_back(buffer);
+        else
+            buffer->unref();
+
+        outputQueue.pop_front();
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////
 int Session::overflow(int value)
 {
@@ -117,11 +339,22 @@ int Session::overflow(int value)
 }
 
 /////////////////////////////////////////////////////////////////////////////
+// Data is only appended to the output queue here. It is sent when
+// the stream is flushed, so that a congested client does not block.
 std::streamsize Session::xsputn(const char * buf, std::streamsize count)
 {
     const char* ptr = buf;
 
-    do {
+    // Output is discarded after an error
+    if (p_eof)
+        return 0;
+
+    while (count) {
+        if (pptr() == epptr()) {
+            closePutArea();
+            newPutArea();
+        }
+
         // Put data into buffer
         size_t n = std::min(epptr() - pptr(), count);
         std::copy(ptr, ptr + n, pptr());
@@ -130,8 +363,7 @@ std::streamsize Session::xsputn(const char * buf, std::streamsize count)
         pbump(n);
         ptr += n;
         count -= n;
-
-    } while (!(pptr() == epptr() and flush(true)) and count);
+    }
 
     return ptr - buf;
 }
@@ -139,64 +371,97 @@ std::streamsize Session::xsputn(const char * buf, std::streamsize count)
 /////////////////////////////////////////////////////////////////////////////
 int Session::sync()
 {
-    return flush(false);
+    return flush();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+ssize_t Session::writev(const struct iovec* iov, int iovcnt)
+{
+    return iovcnt ? write(iov->iov_base, iov->iov_len) : 0;
 }
 
 /////////////////////////////////////////////////////////////////////////////
-// Flush output buffer.
+// Pass as many chunks of the output queue as possible to writev()
+ssize_t Session::writeQueue()
+{
+    struct iovec iov[16];
+    int n = 0;
+
+    for (OutputQueue::const_iterator it = outputQueue.begin();
+            n < 16 and it != outputQueue.end(); ++it, ++n) {
+        iov[n].iov_base = const_cast<char*>(it->begin);
+        iov[n].iov_len  = it->end - it->begin;
+    }
+
+    return writev(iov, n);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Flush output queue.
 //
-// partial: true: do only one flush pass
-int Session::flush(bool partial)
+// Data is sent until the queue is empty or the transport would block.
+// Data that could not be sent remains in the queue.
+int Session::flush()
 {
-    const char* buf = pbase();
-    size_t count = pptr() - buf;
+    closePutArea();
+
+    // Everything up to here is sent uncompressed
+    if (zNext) {
+        zstream = zNext;
+        zNext = 0;
+        zBuffer = newBuffer();
+        zPtr = zBuffer->begin();
+    }
+
+    // Flush the compressor once per call, i.e. once per cycle
+    // of the session
+    if (zstream and zPending)
+        compress(0, 0, true);
 
     if (p_eof)
         return -1;
-    else if (!count)
+    else if (outputQueue.empty())
         return 0;
 
-//    log_debug("flushing %i %zu", partial, count);
-    int result = 0;
+    ssize_t result = 0;
     do {
 #ifdef GNUTLS_FOUND
         switch (state) {
             case NoTLS:
-                result = write(buf, count);
+                result = writeQueue();
                 break;
 
             case InitTLS:
-                // Ignore partial flush request, called from Session::sync()
-                if (!partial)
-                    return 0;
-
-                LOG4CPLUS_FATAL_STR(log,
-                        LOG4CPLUS_TEXT(
-                            "Output buffer overflow during TLS handshake"));
-                result = -ENOSPC;
-                break;
+                // Keep data until the handshake is finished
+                return 0;
 
             case RunTLS:
-                result = gnutls_record_send(tls_session, buf, count);
+                {
+                    // After GNUTLS_E_AGAIN, gnutls requires the same
+                    // data to be passed again
+                    const Chunk& chunk = outputQueue.front();
+                    size_t len = tlsRetryLength
+                        ? tlsRetryLength : chunk.end - chunk.begin;
+
+                    result = gnutls_record_send(tls_session,
+                            chunk.begin, len);
+
+                    tlsRetryLength = result == GNUTLS_E_AGAIN
+                        or result == GNUTLS_E_INTERRUPTED ? len : 0;
+                }
                 break;
         }
 #else
-        result = write(buf, count);
+        result = writeQueue();
 #endif
 
 //        log_debug("flushing result %i", result);
         if (result <= 0)
             break;
 
-        buf   += result;
-        count -= result;
-
-    } while (count and !partial);
+        consume(result);
 
-    // Copy remaining data to buffer start and 
-    // update std::streambuf's current put pointer pptr()
-    std::copy(buf, const_cast<const char*>(pptr()), pbase());
-    pbump(pbase() - buf);
+    } while (!outputQueue.empty());
 
     // Calculate EOF
     if (state == NoTLS)
@@ -221,7 +486,7 @@ int Session::flush(bool partial)
     else
         LOG4CPLUS_ERROR(log,
                 LOG4CPLUS_TEXT("gnutls_record_send(")
-                << count
+                << queued
                 << LOG4CPLUS_TEXT("): ")
                 << LOG4CPLUS_C_STR_TO_TSTRING(gnutls_strerror(result))
                 << LOG4CPLUS_TEXT(" (")
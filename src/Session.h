@@ -25,6 +25,8 @@
 #define SESSION_H
 
 #include <ctime>
+#include <deque>
+#include <vector>
 #include <streambuf>
 #include <unistd.h>
 
@@ -35,6 +37,8 @@
 #endif
 
 class Blacklist;
+struct iovec;
+struct z_stream_s;
 
 namespace log4cplus {
     class Logger;
@@ -44,6 +48,7 @@ namespace PdServ {
 
 class Main;
 class Event;
+class SharedBuffer;
 
 class Session: public std::streambuf {
     public:
@@ -53,10 +58,16 @@ class Session: public std::streambuf {
         virtual ~Session();
 
         const Main * const main;
-        size_t eventId;
 
         bool eof() const;
 
+        // Number of bytes in the output queue that were not yet sent
+        size_t queuedBytes() const;
+
+        // Append [begin, end) of buffer to the output queue without
+        // copying. A reference to buffer is held until the data is sent.
+        void queue(SharedBuffer* buffer, const char* begin, const char* end);
+
 #ifdef GNUTLS_FOUND
         static int gnutls_verify_client(gnutls_session_t);
 #endif
@@ -66,16 +77,65 @@ class Session: public std::streambuf {
 
         int startTLS();
 
+        // Compress all output that follows the next flush() using
+        // deflate. level is the zlib compression level. Returns 0 on
+        // success, -EALREADY if compression was started already
+        int startCompression(int level);
+
+        // Compression statistics
+        size_t compressIn;      // Bytes passed to the compressor
+        size_t compressOut;     // Bytes produced by the compressor
+        double compressTime;    // CPU time spent compressing [s]
+
+        // Output statistics
+        size_t queuedMax;       // High water mark of queuedBytes()
+
+        // The transport functions must not block; return -EAGAIN instead
         virtual ssize_t write(const void* buf, size_t len) = 0;
         virtual ssize_t read(       void* buf, size_t len) = 0;
 
+        // Scatter write. The default implementation calls write() using
+        // the first element only
+        virtual ssize_t writev(const struct iovec* iov, int iovcnt);
+
     private:
         bool p_eof;
         enum {NoTLS, InitTLS, RunTLS} state;
 
         log4cplus::Logger& log;
 
-        int flush(bool partial);
+        // Output queue. The data in the put area of std::streambuf
+        // belongs to putBuffer and is appended to the queue on flush()
+        struct Chunk {
+            SharedBuffer* buffer;
+            const char* begin;
+            const char* end;
+        };
+        typedef std::deque<Chunk> OutputQueue;
+        OutputQueue outputQueue;
+        size_t queued;
+
+        const size_t bufsize;
+        SharedBuffer* putBuffer;
+        std::vector<SharedBuffer*> spareBuffers;
+
+        // Deflate stream; null when output is not compressed
+        struct z_stream_s* zstream;
+        struct z_stream_s* zNext;   // Becomes zstream on the next flush()
+        SharedBuffer* zBuffer;
+        char* zPtr;
+        bool zPending;          // Data was passed to deflate() since the
+                                // last Z_SYNC_FLUSH
+        void compress(const char* begin, const char* end, bool sync);
+
+        void closePutArea();
+        void newPutArea();
+        SharedBuffer* newBuffer();
+        void append(SharedBuffer* buffer, const char* begin, const char* end);
+        void consume(size_t count);
+        ssize_t writeQueue();
+
+        int flush();
 
         // Reimplemented from std::streambuf
         int overflow(int c);
@@ -89,6 +149,11 @@ class Session: public std::streambuf {
         gnutls_session_t tls_session;
         const Blacklist* blacklist;
 
+        // Length passed to gnutls_record_send() that has to be repeated
+        // after GNUTLS_E_AGAIN, 0 if none. The first chunk of the queue
+        // may have been extended in the meantime
+        size_t tlsRetryLength;
+
         static ssize_t gnutls_pull_func(
                 gnutls_transport_ptr_t, void*, size_t);
         static ssize_t gnutls_push_func(
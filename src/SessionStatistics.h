@@ -34,6 +34,12 @@ struct SessionStatistics {
     std::string client;
     size_t countIn;
     size_t countOut;
+    size_t outputQueue;         // Bytes waiting to be sent
+    size_t outputQueueMax;      // High water mark of outputQueue
+    size_t droppedFrames;       // Data frames dropped due to backpressure
+    size_t compressIn;          // Bytes passed to the compressor
+    size_t compressOut;         // Compressed bytes
+    double compressTime;        // CPU time used for compression [s]
     struct timespec connectedTime;
 };
 
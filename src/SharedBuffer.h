@@ -0,0 +1,77 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef SHAREDBUFFER_H
+#define SHAREDBUFFER_H
+
+#include <cstddef>
+#include <new>
+
+namespace PdServ {
+
+/* Reference counted memory block.
+ *
+ * Blocks are used in the output queue of a session. The same block may
+ * be queued on several sessions at the same time, each of them holding
+ * a reference. The block is freed when the last reference is released.
+ */
+class SharedBuffer {
+    public:
+        static SharedBuffer* create(size_t size) {
+            return new (::operator new(sizeof(SharedBuffer) + size))
+                SharedBuffer(size);
+        }
+
+        const size_t size;
+
+        char* begin() {
+            return reinterpret_cast<char*>(this + 1);
+        }
+        char* end() {
+            return begin() + size;
+        }
+
+        SharedBuffer* ref() {
+            __sync_add_and_fetch(&refCount, 1);
+            return this;
+        }
+
+        void unref() {
+            if (!__sync_sub_and_fetch(&refCount, 1)) {
+                this->~SharedBuffer();
+                ::operator delete(this);
+            }
+        }
+
+        bool unique() const {
+            return refCount == 1;
+        }
+
+    private:
+        SharedBuffer(size_t size): size(size), refCount(1) {}
+
+        size_t refCount;
+};
+
+}
+#endif //SHAREDBUFFER_H
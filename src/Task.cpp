@@ -36,3 +36,19 @@ Task::Task(size_t index, double sampleTime):
 Task::~Task()
 {
 }
+
+/////////////////////////////////////////////////////////////////////////////
+void Task::subscribe(SessionTask *st,
+        const Signal* const* signals, size_t n) const
+{
+    for (; n; --n)
+        (*signals++)->subscribe(st);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Task::unsubscribe(SessionTask *st,
+        const Signal* const* signals, size_t n) const
+{
+    for (; n; --n)
+        (*signals++)->unsubscribe(st);
+}
@@ -49,6 +49,14 @@ class Task {
         virtual void cleanup(const SessionTask *) const = 0;
         virtual bool rxPdo(SessionTask *, const struct timespec **tasktime,
                 const PdServ::TaskStatistics **taskStatistics) const = 0;
+
+        // Subscribe to or release several signals at once, so that the
+        // application can pass on the change as a whole. The default
+        // implementation calls Signal::subscribe() for every signal
+        virtual void subscribe(SessionTask *,
+                const Signal* const* signals, size_t n) const;
+        virtual void unsubscribe(SessionTask *,
+                const Signal* const* signals, size_t n) const;
 };
 
 }
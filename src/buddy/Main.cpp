@@ -83,6 +83,7 @@ int Main::serve()
 
     setupLogging();
     postfork_nrt_setup();
+    indexParameters();
     persistTimeout = setupPersistent();
     readPointer = ioctl(fd, RESET_BLOCKIO_RP);
     photoPtr = readPointer;
@@ -431,11 +432,21 @@ bool Main::getPersistentSignalValue(const PdServ::Signal *s,
 /////////////////////////////////////////////////////////////////////////////
 PdServ::Parameter* Main::findParameter(const std::string& path) const
 {
-    for (ParameterList::const_iterator it = parameters.begin();
-            it != parameters.end(); ++it)
-        if ((*it)->path == path)
-            return *it;
-    return 0;
+    return parameterIndex.find(path);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Main::indexParameters()
+{
+    ParameterList::const_iterator it;
+
+    // Paths take precedence over aliases
+    for (it = parameters.begin(); it != parameters.end(); ++it)
+        parameterIndex.insert((*it)->path, *it);
+
+    for (it = parameters.begin(); it != parameters.end(); ++it)
+        if (!(*it)->alias.empty())
+            parameterIndex.insert((*it)->alias, *it);
 }
 
 /////////////////////////////////////////////////////////////////////////////
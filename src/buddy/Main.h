@@ -25,6 +25,7 @@
 #define BUDDY_MAIN_H
 
 #include "../Main.h"
+#include "../PathIndex.h"
 #include "fio_ioctl.h"
 #include <set>
 #include <log4cplus/logger.h>
@@ -87,6 +88,10 @@ class Main: public PdServ::Main {
         typedef std::list<Parameter*> ParameterList;
         ParameterList parameters;
 
+        // Parameter paths and aliases, used by findParameter()
+        PdServ::PathIndex<PdServ::Parameter> parameterIndex;
+        void indexParameters();
+
         int postfork_nrt_setup();
 
         // Reimplemented from PdServ::Main
@@ -121,6 +121,7 @@ int Main::setup()
 
     readConfiguration();
     setupLogging();
+    indexParameters();
     persistTimeout = setupPersistent();
 
     // Initialize library
@@ -468,11 +469,21 @@ int Main::getValue(const Signal *signal, void* dest, struct timespec* time)
 /////////////////////////////////////////////////////////////////////////////
 PdServ::Parameter* Main::findParameter(const std::string& path) const
 {
-    for (ParameterList::const_iterator it = parameters.begin();
-            it != parameters.end(); ++it)
-        if ((*it)->path == path)
-            return *it;
-    return 0;
+    return parameterIndex.find(path);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Main::indexParameters()
+{
+    ParameterList::const_iterator it;
+
+    // Paths take precedence over aliases
+    for (it = parameters.begin(); it != parameters.end(); ++it)
+        parameterIndex.insert((*it)->path, *it);
+
+    for (it = parameters.begin(); it != parameters.end(); ++it)
+        if (!(*it)->alias.empty())
+            parameterIndex.insert((*it)->alias, *it);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -571,8 +582,16 @@ int Main::prefork_init()
     // At the moment there are roughly 6 ptr_align's, take 10 to make sure!
     shmem_len += (10 + task.size())*sizeof(unsigned long);
 
+#ifdef MAP_POPULATE
+    // Anonymous memory is cleared by the kernel already. Let it prefault
+    // the pages as well instead of touching every one of them
+    const int populate = MAP_POPULATE;
+#else
+    const int populate = 0;
+#endif
+
     shmem = ::mmap(0, shmem_len, PROT_READ | PROT_WRITE,
-            MAP_SHARED | MAP_ANON, -1, 0);
+            MAP_SHARED | MAP_ANON | populate, -1, 0);
     if (MAP_FAILED == shmem) {
         // log(LOGCRIT, "could not mmap
         // err << "mmap(): " << strerror(errno);
@@ -582,7 +601,8 @@ int Main::prefork_init()
 
     // Clear memory; at the same time prefault it, so it does not
     // get swapped out
-    ::memset(shmem, 0, shmem_len);
+    if (!populate)
+        ::memset(shmem, 0, shmem_len);
 
     // Now spread the shared memory for the users thereof
 
@@ -29,6 +29,7 @@
 #include <cc++/thread.h>
 
 #include "../Main.h"
+#include "../PathIndex.h"
 
 struct EventData;
 
@@ -101,6 +102,10 @@ class Main: public PdServ::Main, public ost::Thread {
         typedef std::list<Parameter*> ParameterList;
         ParameterList parameters;
 
+        // Parameter paths and aliases, used by findParameter()
+        PdServ::PathIndex<PdServ::Parameter> parameterIndex;
+        void indexParameters();
+
         int readConfiguration();
 
         // Reimplemented from PdServ::Main
@@ -48,11 +48,9 @@ SessionTaskData::SessionTaskData (PdServ::SessionTask *st,
 ////////////////////////////////////////////////////////////////////////////
 SessionTaskData::~SessionTaskData ()
 {
-    for (SignalSet::const_iterator it = subscribedSet.begin();
-            it != subscribedSet.end(); it++) {
-        //log_debug("Auto unsubscribe from %s", (*it)->path.c_str());
-        static_cast<const PdServ::Signal*>(*it)->unsubscribe(sessionTask);
-    }
+    std::vector<const Signal*> list(subscribedSet.begin(), subscribedSet.end());
+    if (!list.empty())
+        unsubscribe(&list[0], list.size());
 }
 
 ////////////////////////////////////////////////////////////////////////////
@@ -100,23 +98,59 @@ void SessionTaskData::init()
 ////////////////////////////////////////////////////////////////////////////
 void SessionTaskData::subscribe(const Signal* s)
 {
-    if (activeSet.find(s) != activeSet.end()
-            or (subscribedSet.insert(s).second
-                and s->task->subscribe(s, this, true)
-                and transferredSet.find(s) != transferredSet.end())) {
-        activeSet.insert(s);
-        sessionTask->newSignal(s);
+    subscribe(&s, 1);
+}
+
+////////////////////////////////////////////////////////////////////////////
+void SessionTaskData::unsubscribe(const Signal* s)
+{
+    unsubscribe(&s, 1);
+}
+
+////////////////////////////////////////////////////////////////////////////
+void SessionTaskData::subscribe(const Signal* const* s, size_t n)
+{
+    std::vector<const Signal*> list;
+    list.reserve(n);
+
+    for (; n; --n, ++s) {
+        if (activeSet.find(*s) != activeSet.end())
+            sessionTask->newSignal(*s);
+        else if (subscribedSet.insert(*s).second)
+            list.push_back(*s);
+    }
+
+    if (list.empty())
         return;
+
+    task->updateSignalList(&list[0], list.size(), this, true);
+
+    // Signals that were subscribed by other sessions already may be
+    // transferred in the current signal list
+    for (std::vector<const Signal*>::const_iterator it = list.begin();
+            it != list.end(); ++it) {
+        if (transferredSet.find(*it) != transferredSet.end()
+                and int(signalListId - (*it)->subscriptionId) >= 0
+                and activeSet.insert(*it).second)
+            sessionTask->newSignal(*it);
     }
 }
 
 ////////////////////////////////////////////////////////////////////////////
-void SessionTaskData::unsubscribe(const Signal* s)
+void SessionTaskData::unsubscribe(const Signal* const* s, size_t n)
 {
-    if (subscribedSet.erase(s)) {
-        activeSet.erase(s);
-        s->task->subscribe(s, this, false);
+    std::vector<const Signal*> list;
+    list.reserve(n);
+
+    for (; n; --n, ++s) {
+        if (subscribedSet.erase(*s)) {
+            activeSet.erase(*s);
+            list.push_back(*s);
+        }
     }
+
+    if (!list.empty())
+        task->updateSignalList(&list[0], list.size(), this, false);
 }
 
 ////////////////////////////////////////////////////////////////////////////
@@ -51,6 +51,11 @@ class SessionTaskData {
         void subscribe(const Signal*);
         void unsubscribe(const Signal*);
 
+        // Subscribe or release several signals with a single update of
+        // the task's signal list
+        void subscribe(const Signal* const* s, size_t n);
+        void unsubscribe(const Signal* const* s, size_t n);
+
         bool rxPdo(const struct timespec **time,
                 const PdServ::TaskStatistics **stat);
         const char *getValue(const PdServ::Signal *) const;
@@ -161,9 +161,9 @@ void Task::nrt_init()
     if (!persistentSet.empty()) {
         persist = new Persistent(this);
 
-        for (PersistentSet::iterator it = persistentSet.begin();
-                it != persistentSet.end(); ++it)
-            static_cast<const PdServ::Signal*>(*it)->subscribe(persist);
+        std::vector<const PdServ::Signal*> list(
+                persistentSet.begin(), persistentSet.end());
+        subscribe(persist, &list[0], list.size());
     }
 }
 
@@ -215,66 +215,91 @@ void Task::getSignalList(const Signal **signalList, size_t *nelem,
 }
 
 /////////////////////////////////////////////////////////////////////////////
-bool Task::subscribe(const Signal* cs, SessionTaskData* st, bool insert)
+// The entries are only published at the end, so that the real time task
+// recalculates its copy list once for all of them
+void Task::updateSignalList(const Signal* const* s, size_t n,
+        SessionTaskData* st, bool insert)
 {
     ost::MutexLock lock(mutex);
-    Signal* signal = const_cast<Signal*>(cs);
 
     struct SignalList *wp = *signalListWp;
 
-    if (++wp == signalListEnd)
-        wp = signalList;
+    for (; n; --n) {
+        const Signal *cs = *s++;
+        Signal* signal = const_cast<Signal*>(cs);
 
-    while (wp == *signalListRp)
-        ost::Thread::sleep(static_cast<unsigned>(sampleTime * 1000 / 2 + 1));
+        if (insert) {
+            bool subscribe = cs->sessions.empty();
 
-    size_t w = cs->dataTypeIndex[cs->dtype.align()];
-    const Signal **scl = signalCopyList[w];
+            signal->sessions.insert(st);
 
-    wp->signal = cs;
+            // Nothing to do if the signal is already subscribed
+            if (!subscribe)
+                continue;
+        }
+        else {
+            bool unsubscribe = !cs->sessions.empty();
 
-    if (insert) {
-        bool subscribe = cs->sessions.empty();
+            signal->sessions.erase(st);
 
-        signal->sessions.insert(st);
+            if (!unsubscribe or !cs->sessions.empty())
+                continue;
+        }
 
-        // return true if the signal is already subscribed
-        if (!subscribe)
-            return true;
+        struct SignalList *next = wp + 1;
+        if (next == signalListEnd)
+            next = signalList;
 
-        wp->action = SignalList::Insert;
+        // The list is full. Publish what is there and wait for the real
+        // time task to make room
+        while (next == *signalListRp) {
+            publishSignalList(wp);
+            ost::Thread::sleep(
+                    static_cast<unsigned>(sampleTime * 1000 / 2 + 1));
+        }
 
-        size_t i = signalTypeCount[w]++;
-        scl[i] = cs;
-        signal->copyListPos = i;
-    }
-    else {
-        bool unsubscribe = !cs->sessions.empty();
+        wp = next;
 
-        signal->sessions.erase(st);
+        size_t w = cs->dataTypeIndex[cs->dtype.align()];
+        const Signal **scl = signalCopyList[w];
 
-        if (!unsubscribe or !cs->sessions.empty())
-            return true;
+        wp->signal = cs;
 
-        wp->action = SignalList::Remove;
-        wp->signalPosition = signal->copyListPos;
+        if (insert) {
+            wp->action = SignalList::Insert;
+
+            size_t i = signalTypeCount[w]++;
+            scl[i] = cs;
+            signal->copyListPos = i;
+        }
+        else {
+            wp->action = SignalList::Remove;
+            wp->signalPosition = signal->copyListPos;
+
+            // Replace s with last signal on the list
+            const Signal *last = scl[--signalTypeCount[w]];
+            scl[signal->copyListPos] = last;
+            signals[last->index]->copyListPos = signal->copyListPos;
+        }
 
-        // Replace s with last signal on the list
-        cs = scl[--signalTypeCount[w]];
-        scl[signal->copyListPos] = cs;
-        signals[cs->index]->copyListPos = signal->copyListPos;
+        wp->signalListId = ++signalListId;
+        signal->subscriptionId = signalListId;
     }
 
-    wp->signalListId = ++signalListId;
-    signal->subscriptionId = signalListId;
+    publishSignalList(wp);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Task::publishSignalList(struct SignalList *wp)
+{
+    if (wp == *signalListWp)
+        return;
 
 #ifdef __GNUC__
     __sync_synchronize();       // write memory barrier
 #endif
 
     *signalListWp = wp;
-
-    return false;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -306,6 +331,34 @@ bool Task::rxPdo (PdServ::SessionTask *s, const struct timespec **time,
     return s->sessionTaskData->rxPdo(time, stat);
 }
 
+/////////////////////////////////////////////////////////////////////////////
+void Task::subscribe(PdServ::SessionTask *st,
+        const PdServ::Signal* const* s, size_t n) const
+{
+    if (!n)
+        return;
+
+    std::vector<const Signal*> list(n);
+    for (size_t i = 0; i < n; ++i)
+        list[i] = static_cast<const Signal*>(s[i]);
+
+    st->sessionTaskData->subscribe(&list[0], n);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Task::unsubscribe(PdServ::SessionTask *st,
+        const PdServ::Signal* const* s, size_t n) const
+{
+    if (!n)
+        return;
+
+    std::vector<const Signal*> list(n);
+    for (size_t i = 0; i < n; ++i)
+        list[i] = static_cast<const Signal*>(s[i]);
+
+    st->sessionTaskData->unsubscribe(&list[0], n);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 void Task::nrt_update()
 {
@@ -68,7 +68,10 @@ class Task: public PdServ::Task {
         void rt_update(const struct timespec *);
         void nrt_update();
 
-        bool subscribe(const Signal* s, SessionTaskData*, bool insert);
+        // Insert or remove signals of a session in the copy list. The
+        // real time task sees all changes at once
+        void updateSignalList(const Signal* const* s, size_t n,
+                SessionTaskData*, bool insert);
         void getSignalList(const Signal ** s, size_t *n,
                 unsigned int *signalListId);
 
@@ -96,6 +99,9 @@ class Task: public PdServ::Task {
         struct SignalList *signalList, *signalListEnd,
                           **signalListRp, **signalListWp;
 
+        // Pass the signal list up to wp on to the real time task
+        void publishSignalList(struct SignalList *wp);
+
         // Structure managed by the realtime thread containing a list of
         // signals which it has to copy into every PDO
         struct CopyList *copyList[4];
@@ -110,6 +116,10 @@ class Task: public PdServ::Task {
         void cleanup(const PdServ::SessionTask *) const;
         bool rxPdo(PdServ::SessionTask *, const struct timespec **tasktime,
                 const PdServ::TaskStatistics **taskStatistics) const;
+        void subscribe(PdServ::SessionTask *,
+                const PdServ::Signal* const* s, size_t n) const;
+        void unsubscribe(PdServ::SessionTask *,
+                const PdServ::Signal* const* s, size_t n) const;
 
         // These methods are used in real time context
         void processSignalList();
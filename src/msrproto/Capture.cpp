@@ -0,0 +1,184 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "../Signal.h"
+#include "../DataType.h"
+#include "../Debug.h"
+#include "XmlElement.h"
+#include "Channel.h"
+#include "Capture.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace MsrProto;
+
+/////////////////////////////////////////////////////////////////////////////
+size_t Capture::sampleSize(const std::vector<const Channel*>& channels)
+{
+    size_t size = sizeof(uint64_t);
+
+    for (std::vector<const Channel*>::const_iterator it = channels.begin();
+            it != channels.end(); ++it)
+        size += (*it)->memSize;
+
+    return size;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+Capture::Capture(const Channel *trigger,
+        const std::vector<const Channel*>& channels,
+        Mode mode, double level, double upper,
+        size_t pre, size_t post, bool repeat,
+        bool base64, std::streamsize precision):
+    trigger(trigger), channels(channels), repeat(repeat),
+    mode(mode), level(level), upper(upper),
+    pre(pre), post(std::max(post, size_t(1))),
+    base64(base64), precision(precision),
+    size(sampleSize(channels)), capacity(this->pre + this->post),
+    ring(size * capacity)
+{
+    head = 0;
+    count = 0;
+    remaining = 0;
+    havePrevious = false;
+    triggerTime = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool Capture::triggered(double value) const
+{
+    switch (mode) {
+        case Rising:
+            return havePrevious and previous < level and value >= level;
+
+        case Falling:
+            return havePrevious and previous > level and value <= level;
+
+        case Edge:
+            return havePrevious
+                and ((previous < level and value >= level)
+                        or (previous > level and value <= level));
+
+        case Level:
+            return value >= level;
+
+        case Window:
+            return value < level or value > upper;
+    }
+
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool Capture::newSample(const PdServ::SessionTask *st, uint64_t time)
+{
+    char *p = &ring[head * size];
+
+    std::memcpy(p, &time, sizeof(time));
+    p += sizeof(time);
+
+    for (std::vector<const Channel*>::const_iterator it = channels.begin();
+            it != channels.end(); ++it) {
+        const char *data = (*it)->signal->getValue(st) + (*it)->offset;
+        p = std::copy(data, data + (*it)->memSize, p);
+    }
+
+    if (++head == capacity)
+        head = 0;
+    if (count < capacity)
+        ++count;
+
+    // Record post trigger samples
+    if (remaining)
+        return !--remaining;
+
+    const char *data = trigger->signal->getValue(st) + trigger->offset;
+    double value = trigger->dtype.getValue(data);
+
+    // Only trigger when enough pre trigger samples are available
+    bool fire = count > pre and triggered(value);
+
+    previous = value;
+    havePrevious = true;
+
+    if (!fire)
+        return false;
+
+    triggerTime = time;
+    remaining = post - 1;
+    return !remaining;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Capture::print(XmlElement &element)
+{
+    struct timespec ts;
+    ts.tv_sec = triggerTime / 1000000000ULL;
+    ts.tv_nsec = triggerTime % 1000000000ULL;
+
+    XmlElement::Attribute(element, "time") << ts;
+    XmlElement::Attribute(element, "pre") << pre;
+    XmlElement::Attribute(element, "post") << post;
+    XmlElement::Attribute(element, "c") << trigger->index;
+
+    // The ring is full; the oldest sample is at head
+    size_t offset = 0;
+    for (size_t n = 0; n <= channels.size(); ++n) {
+        size_t len = n ? channels[n-1]->memSize : sizeof(uint64_t);
+
+        // Collect the values of a channel in buf
+        buf.resize(len * capacity);
+        for (size_t i = 0; i < capacity; ++i) {
+            const char *src = &ring[((head + i) % capacity) * size + offset];
+            std::copy(src, src + len, &buf[i * len]);
+        }
+        offset += len;
+
+        if (!n) {
+            XmlElement time(element.createChild("time"));
+            XmlElement::Attribute(time, "d").base64(&buf[0], buf.size());
+            continue;
+        }
+
+        const Channel *c = channels[n-1];
+        XmlElement datum(element.createChild("F"));
+        XmlElement::Attribute(datum, "c") << c->index;
+
+        XmlElement::Attribute value(datum, "d");
+        if (base64)
+            value.base64(&buf[0], buf.size());
+        else
+            value.csv(c, &buf[0], capacity, precision);
+    }
+
+    rearm();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Capture::rearm()
+{
+    count = 0;
+    remaining = 0;
+    havePrevious = false;
+}
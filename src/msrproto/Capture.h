@@ -0,0 +1,102 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <ios>
+#include <vector>
+#include <stdint.h>
+
+namespace PdServ {
+    class SessionTask;
+}
+
+namespace MsrProto {
+
+class Channel;
+class XmlElement;
+
+/* Triggered capture of a set of channels (oscilloscope mode).
+ *
+ * Every sample of the channels is kept in a ring holding pre + post
+ * samples. When the trigger condition on the trigger channel is met and
+ * at least pre samples were recorded before, another post - 1 samples
+ * are recorded. The complete window, pre samples before the trigger,
+ * the trigger sample and post - 1 samples after it, is then printed.
+ */
+class Capture {
+    public:
+        enum Mode {Rising, Falling, Edge, Level, Window};
+
+        Capture(const Channel *trigger,
+                const std::vector<const Channel*>& channels,
+                Mode mode, double level, double upper,
+                size_t pre, size_t post, bool repeat,
+                bool base64, std::streamsize precision);
+
+        const Channel * const trigger;
+        const std::vector<const Channel*> channels;
+        const bool repeat;              // Rearm after printing
+
+        // Record a sample. Returns true when the window is complete
+        bool newSample(const PdServ::SessionTask *st, uint64_t time);
+
+        // Print attributes and children of the completed window into
+        // element, rearming the capture
+        void print(XmlElement &element);
+
+        // Discard the window and wait for fresh pre trigger samples
+        void rearm();
+
+        static size_t sampleSize(const std::vector<const Channel*>&);
+
+    private:
+        const Mode mode;
+        const double level;
+        const double upper;
+        const size_t pre;
+        const size_t post;
+
+        const bool base64;
+        const std::streamsize precision;
+
+        // Ring of samples: [time][channel 0]...[channel n-1]
+        const size_t size;              // Size of a sample
+        const size_t capacity;          // Number of samples in ring
+        std::vector<char> ring;
+        size_t head;                    // Next sample to write
+        size_t count;                   // Valid samples in ring
+        size_t remaining;               // Samples to record after trigger
+
+        double previous;                // Previous value of trigger
+        bool havePrevious;
+        uint64_t triggerTime;
+
+        std::vector<char> buf;          // Space for printing
+
+        bool triggered(double value) const;
+};
+
+}
+#endif //CAPTURE_H
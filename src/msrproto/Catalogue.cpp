@@ -0,0 +1,140 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "Catalogue.h"
+#include "Channel.h"
+#include "Parameter.h"
+#include "XmlElement.h"
+#include "../Signal.h"
+#include "../Task.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+using namespace MsrProto;
+
+/////////////////////////////////////////////////////////////////////////////
+template <typename T>
+void Catalogue::put(T value)
+{
+    for (size_t i = 0; i < sizeof(T); ++i, value >>= 8)
+        data.append(1, char(value & 0xFF));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Catalogue::build(const VariableTable<Channel>& channels,
+        const VariableTable<Parameter>& parameters)
+{
+    data.assign("MSRC", 4);
+    put(uint32_t(2));
+    put(uint32_t(channels.size()));
+    put(uint32_t(parameters.size()));
+
+    for (std::vector<const Channel*>::const_iterator it =
+            channels.variables().begin();
+            it != channels.variables().end(); ++it) {
+        const Channel *c = *it;
+
+        putVariable(c, c->hidden);
+        put(uint32_t(c->signal->task->index));
+
+        double sampleTime = c->signal->sampleTime();
+        uint64_t bits;
+        ::memcpy(&bits, &sampleTime, sizeof(bits));
+        put(bits);
+    }
+
+    for (std::vector<const Parameter*>::const_iterator it =
+            parameters.variables().begin();
+            it != parameters.variables().end(); ++it) {
+        const Parameter *p = *it;
+        putVariable(p, p->hidden | (p->persistent << 1));
+    }
+
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (std::string::const_iterator it = data.begin();
+            it != data.end(); ++it)
+        h = (h ^ static_cast<unsigned char>(*it)) * 1099511628211ULL;
+
+    static const char hexDigit[] = "0123456789abcdef";
+    hashString.resize(16);
+    for (int i = 15; i >= 0; --i, h >>= 4)
+        hashString[i] = hexDigit[h & 0xF];
+
+    // Format the reply once, the way Variable caches its attributes
+    std::stringbuf buf;
+    XmlStream os(&buf);
+    {
+        XmlElement tmp("", os, 0, 0);
+        os.flush();
+        buf.str(std::string());
+
+        XmlElement::Attribute(tmp, "hash") << hashString;
+        XmlElement::Attribute(tmp, "size") << data.size();
+        XmlElement::Attribute(tmp, "base64value")
+            .base64(data.data(), data.size());
+        os.flush();
+        replyAttributes = buf.str();
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const std::string& Catalogue::hash() const
+{
+    return hashString;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const std::string& Catalogue::attributes() const
+{
+    return replyAttributes;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Catalogue::putVariable(const Variable* v, uint8_t flags)
+{
+    put(uint32_t(v->index));
+    put(uint8_t(v->dtype.isPrimary() ? v->dtype.primary() : 0));
+    put(flags);
+    put(uint32_t(v->dtype.size));
+
+    put(uint8_t(v->dim.size()));
+    for (size_t i = 0; i < v->dim.size(); ++i)
+        put(uint32_t(v->dim[i]));
+    put(uint32_t(v->elementCount()));
+
+    putString(v->path());
+    putString(v->variable->alias);
+    putString(v->variable->unit);
+    putString(v->variable->comment);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Catalogue::putString(const std::string& s)
+{
+    size_t len = std::min(s.size(), size_t(0xFFFF));
+    put(uint16_t(len));
+    data.append(s, 0, len);
+}
@@ -0,0 +1,99 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef CATALOGUE_H
+#define CATALOGUE_H
+
+#include <string>
+#include <stdint.h>
+
+#include "Variable.h"
+
+namespace MsrProto {
+
+class Channel;
+class Parameter;
+
+/* Binary description of all channels and parameters.
+ *
+ * It is built once when the server starts and does not change while the
+ * application runs. Clients fetch it with <catalogue/> instead of
+ * downloading <rk> and <rp>, and skip the transfer altogether when they
+ * have a copy with the hash of the <connected> greeting.
+ *
+ * Layout; integers are little endian, strings are a uint16 length
+ * followed by as many bytes:
+ *
+ *   char[4]    "MSRC"
+ *   uint32     version (2)
+ *   uint32     channel count
+ *   uint32     parameter count
+ *
+ * followed by a record per channel, then per parameter:
+ *
+ *   uint32     index
+ *   uint8      primary type as of PdServ::DataType::Primary, 0 if compound
+ *   uint8      flags: 1 hidden, 2 persistent
+ *   uint32     size of an element in bytes
+ *   uint8      dimension count n
+ *   uint32[n]  dimensions
+ *   uint32     element count m
+ *   string     path, alias, unit, comment
+ *
+ * The counts include the elements of split vectors, which have no record.
+ * The m elements of a variable have the indices following its index. They
+ * are scalars with the type and flags of the variable, and their path is
+ * that of the variable followed by the index of every dimension, e.g.
+ * "/path/1/2".
+ *
+ * and additionally for channels:
+ *
+ *   uint32     task index
+ *   float64    sample time in seconds
+ */
+class Catalogue {
+    public:
+        void build(const VariableTable<Channel>& channels,
+                const VariableTable<Parameter>& parameters);
+
+        // Content hash as hex string
+        const std::string& hash() const;
+
+        // Preformatted attributes of the reply: hash, size and the
+        // catalogue as base64value
+        const std::string& attributes() const;
+
+    private:
+        std::string data;
+        std::string hashString;
+        std::string replyAttributes;
+
+        void putVariable(const Variable* v, uint8_t flags);
+        void putString(const std::string& s);
+        template <typename T>
+            void put(T value);
+};
+
+}
+
+#endif //CATALOGUE_H
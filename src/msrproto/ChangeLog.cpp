@@ -0,0 +1,88 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include "ChangeLog.h"
+
+using namespace MsrProto;
+
+/////////////////////////////////////////////////////////////////////////////
+ChangeLog::ChangeLog(size_t size):
+    slots(new Slot[size]), size(size)
+{
+    // seq = 0 is the state "before position 0"
+    for (size_t i = 0; i < size; ++i)
+        slots[i].seq = 0;
+
+    position = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+ChangeLog::~ChangeLog()
+{
+    delete[] slots;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+unsigned int ChangeLog::head() const
+{
+    return position;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void ChangeLog::append(const Parameter *p, size_t begin, size_t end,
+        unsigned int generation)
+{
+    unsigned int pos = __sync_fetch_and_add(&position, 1);
+    Slot *slot = &slots[pos % size];
+
+    slot->seq = 2*pos + 1;
+    __sync_synchronize();
+
+    slot->entry.parameter = p;
+    slot->entry.begin = begin;
+    slot->entry.end = end;
+    slot->entry.generation = generation;
+    __sync_synchronize();
+
+    slot->seq = 2*pos + 2;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+int ChangeLog::read(unsigned int pos, Entry& entry) const
+{
+    const Slot *slot = &slots[pos % size];
+    unsigned int seq = slot->seq;
+    __sync_synchronize();
+
+    // Difference to the expected sequence number. Positions wrap around,
+    // so compare the signed difference
+    int diff = static_cast<int>(seq - (2*pos + 2));
+    if (diff < 0)
+        return 0;
+    else if (diff > 0)
+        return -1;
+
+    entry = slot->entry;
+    __sync_synchronize();
+
+    return slot->seq == seq ? 1 : -1;
+}
@@ -0,0 +1,80 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#ifndef CHANGELOG_H
+#define CHANGELOG_H
+
+#include <cstddef>
+
+namespace MsrProto {
+
+class Parameter;
+
+/* Global log of parameter changes.
+ *
+ * Writers append an entry in O(1) without locking, irrespective of the
+ * number of sessions. Every session keeps its own cursor and consumes
+ * the log in its own thread. When a session falls behind by more than
+ * the size of the ring, read() reports an overrun and the session has
+ * to assume that all parameters changed.
+ *
+ * Any number of writers and readers may use the log concurrently.
+ */
+class ChangeLog {
+    public:
+        ChangeLog(size_t size = 1024);
+        ~ChangeLog();
+
+        struct Entry {
+            const Parameter *parameter;
+            size_t begin;               // Changed byte range
+            size_t end;
+            unsigned int generation;    // Parameter generation after
+                                        // change, reported with <pu>
+        };
+
+        void append(const Parameter *p, size_t begin, size_t end,
+                unsigned int generation);
+
+        // Position of the next entry to be written
+        unsigned int head() const;
+
+        // Read the entry at pos. Returns
+        //  1: entry copied
+        //  0: entry is not yet written
+        // -1: entry was overwritten (reader is too slow)
+        int read(unsigned int pos, Entry& entry) const;
+
+    private:
+        struct Slot {
+            volatile unsigned int seq;  // 2*pos+1 while writing, 2*pos+2
+            Entry entry;                // when entry of pos is valid
+        };
+
+        Slot * const slots;
+        const size_t size;
+        volatile unsigned int position;
+};
+
+}
+
+#endif // CHANGELOG_H
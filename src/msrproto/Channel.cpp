@@ -41,28 +41,43 @@ Channel::Channel(const PdServ::Signal *s, size_t index,
 }
 
 /////////////////////////////////////////////////////////////////////////////
-void Channel::setXmlAttributes( XmlElement &element, bool shortReply,
-        const char *data, std::streamsize precision, struct timespec* time) const
+Channel::Channel(const Channel* parent, size_t n):
+    Variable(parent, n),
+    signal(parent->signal)
 {
-    setAttributes(element, shortReply);
+}
 
-    if (!shortReply) {
-        // <channel name="/lan/World Time" alias="" index="0" typ="TDBL"
-        //   datasize="8" bufsize="500" HZ="50" unit=""
-        //   value="1283134199.93743"/>
-        double freq = 1.0 / signal->sampleTime();
+/////////////////////////////////////////////////////////////////////////////
+Variable* Channel::createElement(size_t n) const
+{
+    return new Channel(this, n);
+}
 
-        // The MSR protocol wants a bufsize, the maximum number of
-        // values that can be retraced. This artificial limitation does
-        // not exist any more. Instead, choose a buffer size so that
-        // at a maximum of 10 seconds has to be stored.
-        size_t bufsize = 10 * std::max(1U, (unsigned int)(freq + 0.5));
+/////////////////////////////////////////////////////////////////////////////
+void Channel::setStaticAttributes(XmlElement &element) const
+{
+    // <channel name="/lan/World Time" alias="" index="0" typ="TDBL"
+    //   datasize="8" bufsize="500" HZ="50" unit=""
+    //   value="1283134199.93743"/>
+    double freq = 1.0 / signal->sampleTime();
 
-        // bufsize=
-        XmlElement::Attribute(element, "bufsize") << bufsize;
-        XmlElement::Attribute(element, "task") << signal->task->index;
-        XmlElement::Attribute(element, "HZ") << freq;
-    }
+    // The MSR protocol wants a bufsize, the maximum number of
+    // values that can be retraced. This artificial limitation does
+    // not exist any more. Instead, choose a buffer size so that
+    // at a maximum of 10 seconds has to be stored.
+    size_t bufsize = 10 * std::max(1U, (unsigned int)(freq + 0.5));
+
+    // bufsize=
+    XmlElement::Attribute(element, "bufsize") << bufsize;
+    XmlElement::Attribute(element, "task") << signal->task->index;
+    XmlElement::Attribute(element, "HZ") << freq;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Channel::setXmlAttributes( XmlElement &element, bool shortReply,
+        const char *data, std::streamsize precision, struct timespec* time) const
+{
+    setAttributes(element, shortReply);
 
     if (time)
         XmlElement::Attribute(element, "time") << *time;
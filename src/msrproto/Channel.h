@@ -46,6 +46,14 @@ class Channel: public Variable {
                 struct timespec* time) const;
 
         const PdServ::Signal* const signal;
+
+    private:
+        // View of element n of a split channel
+        Channel(const Channel* parent, size_t n);
+
+        // Reimplemented from Variable
+        void setStaticAttributes(XmlElement &element) const;
+        Variable* createElement(size_t n) const;
 };
 
 }
@@ -25,23 +25,87 @@
 
 #include "DirectoryNode.h"
 #include "HyperDirNode.h"
-#include "XmlElement.h"
 #include "Parameter.h"
 #include "Channel.h"
-#include "XmlParser.h"
 #include "../Debug.h"
-#include "../Parameter.h"
 
 #include <locale>
-#include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 
 using namespace MsrProto;
 
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+NameTable::NameTable(): pos(0), avail(0)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+NameTable::~NameTable()
+{
+    for (std::vector<char*>::iterator it = blocks.begin();
+            it != blocks.end(); ++it)
+        delete[] *it;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const char* NameTable::intern(const std::string& name)
+{
+    const char* s = index.find(name);
+    if (s)
+        return s;
+
+    const size_t len = name.size() + 1;
+    if (len > avail) {
+        const size_t blockSize = 65536;
+        avail = std::max(len, blockSize);
+        pos = new char[avail];
+        blocks.push_back(pos);
+    }
+
+    std::copy(name.c_str(), name.c_str() + len, pos);
+    index.insert(name, pos);
+
+    s = pos;
+    pos += len;
+    avail -= len;
+
+    return s;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+TempNode::TempNode(): node(0)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+TempNode::~TempNode()
+{
+    delete node;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void TempNode::reset(DirectoryNode* node)
+{
+    if (node != this->node) {
+        delete this->node;
+        this->node = node;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+DirectoryNode* TempNode::get() const
+{
+    return node;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
 DirectoryNode::DirectoryNode(DirectoryNode* parent, const std::string& name):
-    parent(this)
+    parent(this), name(0), childMap(0)
 {
     if (parent)
         parent->adopt(this, name);
@@ -50,22 +114,129 @@ DirectoryNode::DirectoryNode(DirectoryNode* parent, const std::string& name):
 /////////////////////////////////////////////////////////////////////////////
 DirectoryNode::~DirectoryNode()
 {
-    for (ChildMap::iterator it = children.begin();
+    if (childMap) {
+        for (ChildMap::iterator it = childMap->begin();
+                it != childMap->end(); ++it)
+            delete it->second;
+        delete childMap;
+    }
+
+    for (Children::iterator it = children.begin();
             it != children.end(); ++it)
-        delete it->second;
+        delete it->node;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool DirectoryNode::Child::operator<(const char* other) const
+{
+    return ::strcmp(name, other) < 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const DirectoryNode::Child* DirectoryNode::findChild(
+        const std::string& name) const
+{
+    Children::const_iterator it = std::lower_bound(
+            children.begin(), children.end(), name.c_str());
+
+    return it != children.end() and it->name == name ? &*it : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const DirectoryNode* DirectoryNode::child(
+        const std::string& name, size_t* pos) const
+{
+    const Child* c = findChild(name);
+    if (c) {
+        if (pos)
+            *pos = c - &children[0];
+        return c->node;
+    }
+
+    // Virtual children are named by their position, without leading
+    // zeros
+    const size_t count = virtualChildCount();
+    if (!count or name.empty() or name.size() > 19
+            or (name[0] == '0' and name.size() > 1))
+        return 0;
+
+    size_t n = 0;
+    for (std::string::const_iterator it = name.begin();
+            it != name.end(); ++it) {
+        if (*it < '0' or *it > '9')
+            return 0;
+        n = 10 * n + (*it - '0');
+    }
+
+    if (n >= count)
+        return 0;
+
+    if (pos)
+        *pos = children.size() + n;
+    return virtualChild(n, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const DirectoryNode* DirectoryNode::child(size_t pos,
+        TempNode* tmp) const
+{
+    return pos < children.size()
+        ? children[pos].node
+        : virtualChild(pos - children.size(), tmp);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+size_t DirectoryNode::virtualChildCount() const
+{
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const DirectoryNode* DirectoryNode::virtualChild(size_t,
+        TempNode*) const
+{
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void DirectoryNode::compact(NameTable& names)
+{
+    if (!childMap)
+        return;
+
+    // The map is sorted already
+    children.reserve(childMap->size());
+    for (ChildMap::const_iterator it = childMap->begin();
+            it != childMap->end(); ++it) {
+        Child child;
+        child.name = names.intern(it->first);
+        child.node = it->second;
+        child.node->rename(child.name, this);
+        child.node->compact(names);
+        children.push_back(child);
+    }
+
+    delete childMap;
+    childMap = 0;
 }
 
 /////////////////////////////////////////////////////////////////////////////
 DirectoryNode* DirectoryNode::create(const std::string& name)
 {
-    DirectoryNode* dir = children[name];
+    if (!childMap)
+        childMap = new ChildMap;
+
+    DirectoryNode* dir = (*childMap)[name];
     return dir ? dir : new DirectoryNode(this, name);
 }
 
 /////////////////////////////////////////////////////////////////////////////
 void DirectoryNode::insert(DirectoryNode* node, const std::string& name)
 {
-    DirectoryNode* dir = children[name];
+    if (!childMap)
+        childMap = new ChildMap;
+
+    DirectoryNode* dir = (*childMap)[name];
 
 //    log_debug("%s %p", name.c_str(), dir);
     if (dir)
@@ -78,81 +249,216 @@ void DirectoryNode::insert(DirectoryNode* node, const std::string& name)
 void DirectoryNode::traditionalPathInsert(Variable* var,
         const std::string& path, char& hidden, char& persistent)
 {
-    DirQ dirQ;
-    size_t pos = 0;
-
     hidden = 0;
-    while (pos != path.npos) {
+    insertPath(var, path, &hidden, &persistent);
+}
 
-        std::string name = split(path, pos);
-        if (name.empty())
-            continue;
+/////////////////////////////////////////////////////////////////////////////
+void DirectoryNode::pathInsert(Variable* var, const std::string& path)
+{
+    insertPath(var, path, 0, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void DirectoryNode::insertPath(Variable* var, const std::string& path,
+        char* hidden, char* persistent)
+{
+    PathTokenizer tokenizer(path);
+    DirectoryNode* dir = this;
+    std::string name, next;
 
-        size_t nameEnd = name.find('<');
+    // All components but the last one are directories
+    if (!tokenizer.next(name, hidden, persistent))
+        return;
 
-        if (nameEnd != name.npos) {
-            std::stringbuf buf(name);
-            XmlParser parser;
-            parser.read(&buf);
+    while (tokenizer.next(next, hidden, persistent)) {
+        dir = dir->create(name);
+        name.swap(next);
+    }
 
-            if (parser) {
-                const char *value;
-                if (parser.isTrue("hide"))
-                    hidden = 1;
-                else if (parser.find("hide", &value))
-                    hidden = *value;
+    dir->insert(var, name);
+}
 
-                if (parser.isTrue("unhide"))
-                    hidden = 0;
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+DirectoryNode::PathTokenizer::PathTokenizer(const std::string& path):
+    pos(path.data()), end(path.data() + path.size())
+{
+}
 
-                if (parser.find("persistent"))
-                    persistent = parser.isTrue("persistent");
+/////////////////////////////////////////////////////////////////////////////
+bool DirectoryNode::PathTokenizer::next(std::string& name,
+        char* hidden, char* persistent)
+{
+    while (pos != end) {
+        if (*pos == '/') {
+            ++pos;
+            continue;
+        }
 
-                while (nameEnd
-                        and std::isspace(name[nameEnd-1],
-                            std::locale::classic()))
-                    nameEnd--;
+        const char* begin = pos;
+        pos = std::find(pos, end, '/');
+
+        const char* nameEnd = pos;
+        if (hidden) {
+            const char* markup = std::find(begin, pos, '<');
+            if (markup != pos
+                    and parseMarkup(markup, pos, *hidden, *persistent)) {
+                nameEnd = markup;
+                while (nameEnd != begin and isSpace(nameEnd[-1]))
+                    --nameEnd;
             }
-            else
-                nameEnd = name.npos;
         }
 
-        if (name.empty() or !nameEnd)
-            continue;
-
-        dirQ.push(std::string(name, 0, nameEnd));
+        // A component consisting of markup only is skipped
+        if (nameEnd != begin) {
+            name.assign(begin, nameEnd);
+            return true;
+        }
     }
 
-    insert(var, dirQ);
+    return false;
 }
 
 /////////////////////////////////////////////////////////////////////////////
-void DirectoryNode::insert(Variable* var, DirQ& dirQ)
+// Space as of the classic locale
+bool DirectoryNode::PathTokenizer::isSpace(char c)
 {
-    std::string name = dirQ.front();
-    dirQ.pop();
+    return c == ' ' or (c >= '\t' and c <= '\r');
+}
 
-    if (dirQ.empty())
-        return insert(var, name);
+/////////////////////////////////////////////////////////////////////////////
+// Attribute value as XmlParser::isTrue() interprets it. A missing value
+// is true
+bool DirectoryNode::PathTokenizer::isTrue(
+        const char* value, const char* valueEnd)
+{
+    if (!value)
+        return true;
+
+    switch (valueEnd - value) {
+        case 1:
+            return *value == '1';
+        case 2:
+            return !::strncasecmp(value, "on", 2);
+        case 4:
+            return !::strncasecmp(value, "true", 4);
+    }
 
-    return create(name)->insert(var, dirQ);
+    return false;
 }
 
-
 /////////////////////////////////////////////////////////////////////////////
-void DirectoryNode::pathInsert(Variable* var, const std::string& path)
+// Parse the markup of a component, e.g. "<hide=p persistent>", the way
+// XmlParser would, and apply it. The markup begins at the first '<'
+// that is followed by a letter. Returns false if it is not well formed,
+// in which case it is part of the name.
+bool DirectoryNode::PathTokenizer::parseMarkup(const char* p,
+        const char* end, char& hidden, char& persistent)
 {
-    DirQ dirQ;
-    size_t pos = 0;
+    const std::locale& classic = std::locale::classic();
+
+    // Values of the first occurrence of the attributes of interest
+    enum {Hide, Unhide, Persistent, AttrCount};
+    static const char* const attrName[AttrCount] =
+        {"hide", "unhide", "persistent"};
+    bool found[AttrCount];
+    const char* value[AttrCount] = {0, 0, 0};
+    const char* valueEnd[AttrCount] = {0, 0, 0};
+
+    // Like XmlParser, skip malformed elements and continue with the next
+    // one. Only running out of characters is an error
+    for (bool complete = false; !complete; ) {
+        p = std::find(p, end, '<');
+        if (end - p < 3)
+            return false;
+        if (!std::isalpha(*++p, classic))
+            continue;
 
-    while (pos != path.npos) {
+        std::fill_n(found, size_t(AttrCount), false);
+
+        for (;;) {
+            while (p != end and *p == ' ')
+                ++p;
+            if (p == end)
+                return false;
+
+            // End of element
+            if (*p == '/') {
+                if (end - p < 2)
+                    return false;
+                p += 2;
+                complete = p[-1] == '>';
+                break;
+            }
+            if (!std::isalpha(*p, classic)) {
+                complete = *p == '>';
+                break;
+            }
+
+            // Attribute name ends with one of "= />"
+            const char* argument = p;
+            while (p != end and *p != '=' and *p != ' '
+                    and *p != '/' and *p != '>')
+                ++p;
+            if (p == end)
+                return false;
+            const char* argumentEnd = p;
+
+            const char *v = 0, *vEnd = 0;
+            if (*p == '=') {
+                if (end - p < 2)
+                    return false;
+
+                const char quote = p[1];
+                if (quote == '"' or quote == '\'') {
+                    if (end - p < 3)
+                        return false;
+                    v = p + 2;
+                    vEnd = std::find(v, end, quote);
+                    if (end - vEnd < 2)
+                        return false;
+                    p = vEnd + 1;
+                }
+                else {
+                    // The first character always belongs to the value
+                    v = p + 1;
+                    p = v + 1;
+                }
+
+                // Skip to the next attribute
+                while (p != end and *p != ' ' and *p != '>')
+                    ++p;
+                if (p == end)
+                    return false;
+
+                if (!vEnd)
+                    vEnd = p;
+            }
 
-        std::string name = split(path, pos);
-        if (!name.empty())
-            dirQ.push(name);
+            const size_t len = argumentEnd - argument;
+            for (int i = 0; i < AttrCount; ++i) {
+                if (!found[i] and !::strncmp(attrName[i], argument, len)
+                        and !attrName[i][len]) {
+                    found[i] = true;
+                    value[i] = v;
+                    valueEnd[i] = vEnd;
+                }
+            }
+        }
     }
 
-    insert(var, dirQ);
+    if (found[Hide])
+        hidden = isTrue(value[Hide], valueEnd[Hide])
+            ? 1 : (valueEnd[Hide] != value[Hide] ? *value[Hide] : 0);
+
+    if (found[Unhide] and isTrue(value[Unhide], valueEnd[Unhide]))
+        hidden = 0;
+
+    if (found[Persistent])
+        persistent = isTrue(value[Persistent], valueEnd[Persistent]);
+
+    return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -185,8 +491,13 @@ void DirectoryNode::adopt (DirectoryNode *child, const std::string& name)
 {
 //    log_debug("%s %p", name.c_str(), child);
 
-    children[name] = child;
-    child->rename(&children.find(name)->first, this);
+    if (!childMap)
+        childMap = new ChildMap;
+
+    ChildMap::iterator it =
+        childMap->insert(std::make_pair(name, child)).first;
+    it->second = child;
+    child->rename(it->first.c_str(), this);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -196,87 +507,162 @@ bool DirectoryNode::isRoot() const
 }
 
 /////////////////////////////////////////////////////////////////////////////
-void DirectoryNode::rename (const std::string* name, DirectoryNode *parent)
+void DirectoryNode::rename (const char* name, DirectoryNode *parent)
 {
     this->parent = parent;
     this->name = name;
 }
 
 /////////////////////////////////////////////////////////////////////////////
-void DirectoryNode::list( PdServ::Session *session, XmlElement& parent,
+const DirectoryNode* DirectoryNode::listNode(
         const std::string& path, size_t pos) const
 {
     std::string name;
-    ChildMap::const_iterator it;
 
     if (pos != path.npos) {
         do {
             name = split(path, pos);
         } while (name.empty() and pos != name.npos);
 
-        it = children.find(name);
         if (!name.empty()) {
-            if (it != children.end())
-                it->second->list(session, parent, path, pos);
-            return;
+            const DirectoryNode* node = child(name);
+            return node ? node->listNode(path, pos) : 0;
         }
     }
 
-    for (it = children.begin(); it != children.end(); ++it) {
-        const Parameter *param = dynamic_cast<const Parameter *>(it->second);
-        if (param and !param->hidden) {
-            char buf[param->mainParam->memSize];
-            struct timespec ts;
+    return this;
+}
 
-            param->mainParam->getValue(session, buf, &ts);
+/////////////////////////////////////////////////////////////////////////////
+std::string DirectoryNode::path() const
+{
+//    log_debug("this=%p parent=%p", this, parent);
+    return isRoot() ? std::string() : parent->path() + '/' + name;
+}
 
-            XmlElement xml(parent.createChild("parameter"));
-            param->setXmlAttributes(xml, buf, ts, 0, 0, 16);
-        }
+/////////////////////////////////////////////////////////////////////////////
+const DirectoryNode *DirectoryNode::find(
+        const std::string& path, size_t pos) const
+{
+    const DirectoryNode* node = child(split(path, pos));
+    if (!node)
+        return 0;
 
-        const Channel *channel = dynamic_cast<const Channel   *>(it->second);
-        if (channel and !channel->hidden) {
-            XmlElement xml(parent.createChild("channel"));
-            channel->setXmlAttributes(xml, 0, 0, 0, 0);
-        }
+    return pos < path.size() ? node->find(path, pos) : node;
+}
 
-        // If there are children, report this node as a directory
-        if (!channel and !param) {
-            XmlElement el(parent.createChild("dir"));
-            XmlElement::Attribute(el, "path")
-                .setEscaped(this->path() + '/' + it->first);
-        }
+/////////////////////////////////////////////////////////////////////////////
+void DirectoryNode::index(Index& index, std::string& prefix) const
+{
+    const size_t len = prefix.size();
+
+    for (Children::const_iterator it = children.begin();
+            it != children.end(); ++it) {
+        prefix.append(1, '/').append(it->name);
+        index.insert(prefix, it->node);
+        it->node->index(index, prefix);
+        prefix.resize(len);
     }
 }
 
 /////////////////////////////////////////////////////////////////////////////
-std::string DirectoryNode::path() const
+/////////////////////////////////////////////////////////////////////////////
+DirectoryNode::Walker::Walker(const DirectoryNode* root, size_t maxDepth):
+    root(root), maxDepth(maxDepth ? maxDepth : ~size_t(0)),
+    currentPath(root->path())
 {
-//    log_debug("this=%p parent=%p", this, parent);
-    return isRoot() ? std::string() : parent->path() + '/' + *name;
+    push(root, 0);
 }
 
 /////////////////////////////////////////////////////////////////////////////
-const DirectoryNode *DirectoryNode::find(
-        const std::string& path, size_t pos) const
+void DirectoryNode::Walker::push(const DirectoryNode* node, size_t pos)
 {
-    std::string name = split(path, pos);
+    Level level;
+    level.node = node;
+    level.pos = pos;
+    level.pathLength = currentPath.size();
+    stack.push_back(level);
+}
 
-    ChildMap::const_iterator it = children.find(name);
-    if (it == children.end())
-        return 0;
+/////////////////////////////////////////////////////////////////////////////
+bool DirectoryNode::Walker::seek(const DirectoryNode* node)
+{
+    // Ancestors of node up to root, node first
+    std::vector<const DirectoryNode*> chain;
+    for (const DirectoryNode* n = node; n != root; n = n->parent) {
+        if (n->isRoot() or chain.size() == maxDepth)
+            return false;
+        chain.push_back(n);
+    }
+
+    stack.clear();
+    currentPath = root->path();
+
+    const DirectoryNode* dir = root;
+    for (; !chain.empty(); chain.pop_back()) {
+        size_t pos;
+        const DirectoryNode* child = dir->child(chain.back()->name, &pos);
+        if (child != chain.back())
+            return false;
+
+        push(dir, pos + 1);
+        currentPath.append(1, '/').append(child->name);
+        dir = child;
+    }
 
-    return pos < path.size()
-        ? it->second->find(path, pos)
-        : it->second;
+    // node was visited already; its children are next
+    if (stack.size() < maxDepth)
+        push(dir, 0);
+
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const DirectoryNode* DirectoryNode::Walker::next()
+{
+    while (!stack.empty()) {
+        Level& level = stack.back();
+        if (level.pos == level.node->childCount()) {
+            stack.pop_back();
+            continue;
+        }
+
+        const DirectoryNode* child = level.node->child(level.pos++, &tmp);
+        currentPath.resize(level.pathLength);
+        currentPath.append(1, '/').append(child->name);
+
+        if (stack.size() < maxDepth and child->childCount())
+            push(child, 0);
+
+        return child;
+    }
+
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool DirectoryNode::Walker::atEnd() const
+{
+    for (std::vector<Level>::const_iterator it = stack.begin();
+            it != stack.end(); ++it)
+        if (it->pos < it->node->childCount())
+            return false;
+
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const std::string& DirectoryNode::Walker::path() const
+{
+    return currentPath;
 }
 
 /////////////////////////////////////////////////////////////////////////////
 void DirectoryNode::dump() const
 {
 //    log_debug("%s", path().c_str());
-    for (ChildMap::const_iterator it = children.begin();
+    for (Children::const_iterator it = children.begin();
             it != children.end(); ++it) {
-        it->second->dump();
+        it->node->dump();
     }
 }
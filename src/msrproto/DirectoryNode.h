@@ -25,17 +25,56 @@
 #define DIRECTORYNODE_H
 
 #include <string>
-#include <queue>
+#include <vector>
 #include <map>
 
-namespace PdServ {
-    class Session;
-}
+#include "../PathIndex.h"
 
 namespace MsrProto {
 
 class Variable;
-class XmlElement;
+class DirectoryNode;
+
+/* Storage for node names.
+ *
+ * Every distinct name is stored only once in large blocks of memory. Since
+ * the elements of split vectors share their names (0, 1, 2, ...), a tree
+ * of a large model needs few of them.
+ */
+class NameTable {
+    public:
+        NameTable();
+        ~NameTable();
+
+        // Returns the permanent copy of name
+        const char* intern(const std::string& name);
+
+    private:
+        PdServ::PathIndex<const char> index;
+
+        std::vector<char*> blocks;
+        char* pos;
+        size_t avail;
+};
+
+/* Owner of a node that is created for a single caller only, e.g. an
+ * element of a split vector that is not kept by its vector. The node is
+ * deleted on reset() and destruction.
+ */
+class TempNode {
+    public:
+        TempNode();
+        ~TempNode();
+
+        void reset(DirectoryNode* node = 0);
+        DirectoryNode* get() const;
+
+    private:
+        DirectoryNode* node;
+
+        TempNode(const TempNode&);
+        TempNode& operator=(const TempNode&);
+};
 
 class DirectoryNode {
     public:
@@ -43,8 +82,47 @@ class DirectoryNode {
                 const std::string& name = std::string());
         virtual ~DirectoryNode();
 
-        void list(PdServ::Session *, XmlElement& parent,
-                const std::string& path, size_t pos = 0) const;
+        // Node that <list> reports, 0 if the path does not exist
+        const DirectoryNode* listNode(const std::string& path,
+                size_t pos = 0) const;
+
+        // Depth first traversal of the nodes below a node in path order.
+        // A node is visited before its children.
+        class Walker {
+            public:
+                // Descend at most maxDepth levels, 0 is unlimited
+                Walker(const DirectoryNode* root, size_t maxDepth);
+
+                // Continue after node. Returns false if node is not
+                // within reach of the walk
+                bool seek(const DirectoryNode* node);
+
+                // The next node, 0 at the end of the walk. An element
+                // of a split vector is only valid until the next call
+                const DirectoryNode* next();
+                bool atEnd() const;
+
+                // Path of the node returned last
+                const std::string& path() const;
+
+            private:
+                const DirectoryNode* const root;
+                const size_t maxDepth;
+
+                struct Level {
+                    const DirectoryNode* node;
+                    size_t pos;             // Next child
+                    size_t pathLength;      // Path of node
+                };
+                std::vector<Level> stack;
+                std::string currentPath;
+
+                // Element returned last, unless it is in use elsewhere
+                TempNode tmp;
+
+                void push(const DirectoryNode* node, size_t pos);
+        };
+
         std::string path() const;
 
         void dump() const;
@@ -62,12 +140,33 @@ class DirectoryNode {
 
         const DirectoryNode* find(const std::string&, size_t pos) const;
 
+        // Insert every node below this one into the index. The key is
+        // the path that find() resolves, appended to prefix
+        typedef PdServ::PathIndex<const DirectoryNode> Index;
+        void index(Index& index, std::string& prefix) const;
+
+        // Finish building the tree. The children of every node are moved
+        // into a sorted array and their names into the name table.
+        // Lookups and listings require a compacted tree, while nodes
+        // can only be inserted before.
+        void compact(NameTable& names);
+
     protected:
 
         size_t childCount() const {
-            return children.size();
+            return children.size() + (childMap ? childMap->size() : 0)
+                + virtualChildCount();
         }
 
+        // Children that are computed on demand, e.g. the elements of
+        // split vectors. They are named by their position "0", "1", ...
+        // and follow the other children in a walk. They are neither
+        // indexed nor owned by this node. With tmp, a child that does
+        // not exist yet may be created in tmp for the caller only
+        virtual size_t virtualChildCount() const;
+        virtual const DirectoryNode* virtualChild(size_t n,
+                TempNode* tmp) const;
+
         // Insert the last node as a leaf
         virtual void insertLeaf(DirectoryNode* child);
 
@@ -75,18 +174,61 @@ class DirectoryNode {
         void adopt(DirectoryNode* child, const std::string& path);
 
         // Method on a node to set the name and ancestory
-        void rename(const std::string* name, DirectoryNode* parent);
+        void rename(const char* name, DirectoryNode* parent);
 
 
     private:
         DirectoryNode * parent;
-        const std::string* name;
+        const char* name;
 
+        // Children while the tree is built, 0 for leaves and after
+        // compact()
         typedef std::map<std::string, DirectoryNode*> ChildMap;
-        ChildMap children;
-
-        typedef std::queue<std::string> DirQ;
-        void insert(Variable* node, DirQ&);
+        ChildMap* childMap;
+
+        // Children of the compacted tree, sorted by name
+        struct Child {
+            const char* name;
+            DirectoryNode* node;
+
+            bool operator<(const char* other) const;
+        };
+        typedef std::vector<Child> Children;
+        Children children;
+
+        const Child* findChild(const std::string& name) const;
+
+        // Child by name, including the virtual ones. pos is set to its
+        // position in a walk
+        const DirectoryNode* child(const std::string& name,
+                size_t* pos = 0) const;
+        const DirectoryNode* child(size_t pos,
+                TempNode* tmp = 0) const;
+
+        // Insert var at path. Markup in the path is interpreted if
+        // hidden is not 0
+        void insertPath(Variable* var, const std::string& path,
+                char* hidden, char* persistent);
+
+        // Single pass splitting of a path into its components
+        class PathTokenizer {
+            public:
+                PathTokenizer(const std::string& path);
+
+                // Get the next non-empty component. Returns false at the
+                // end of the path
+                bool next(std::string& name,
+                        char* hidden, char* persistent);
+
+            private:
+                const char* pos;
+                const char* const end;
+
+                static bool isSpace(char c);
+                static bool isTrue(const char* value, const char* valueEnd);
+                static bool parseMarkup(const char* p, const char* end,
+                        char& hidden, char& persistent);
+        };
 
         bool isRoot() const;
         static std::string split(const std::string& path, size_t& pos);
@@ -35,17 +35,31 @@ bool Event::toXml(Session* session, const PdServ::EventData& eventData)
 
     if (event) {
         XmlElement msg(session->createElement(levelString(event)));
-
-        XmlElement::Attribute(msg, "name").setEscaped(event->path);
-        if (event->nelem > 1)
-            XmlElement::Attribute(msg, "index") << eventData.index;
-        XmlElement::Attribute(msg, "state") << eventData.state;
-        XmlElement::Attribute(msg, "time") << eventData.time;
+        setAttributes(msg, eventData);
     }
 
     return event;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+void Event::toXml(XmlStream& os, const PdServ::EventData& eventData)
+{
+    XmlElement msg(levelString(eventData.event), os, 0, 0);
+    setAttributes(msg, eventData);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Event::setAttributes(XmlElement& msg, const PdServ::EventData& eventData)
+{
+    const PdServ::Event* event = eventData.event;
+
+    XmlElement::Attribute(msg, "name").setEscaped(event->path);
+    if (event->nelem > 1)
+        XmlElement::Attribute(msg, "index") << eventData.index;
+    XmlElement::Attribute(msg, "state") << eventData.state;
+    XmlElement::Attribute(msg, "time") << eventData.time;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 const char *Event::levelString(const PdServ::Event *e)
 {
@@ -32,14 +32,20 @@ namespace PdServ {
 namespace MsrProto {
 
 class Session;
+class XmlElement;
+class XmlStream;
 
 class Event {
     public:
         static bool toXml(Session* session,
                 const PdServ::EventData& eventData);
+        static void toXml(XmlStream& os,
+                const PdServ::EventData& eventData);
 
     private:
         static const char* levelString(const PdServ::Event *e);
+        static void setAttributes(XmlElement& msg,
+                const PdServ::EventData& eventData);
 };
 
 }
@@ -0,0 +1,154 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "../Config.h"
+#include "../Signal.h"
+#include "../Task.h"
+#include "History.h"
+#include "HistoryRing.h"
+#include "Server.h"
+#include "Channel.h"
+
+#include <log4cplus/loggingmacros.h>
+
+using namespace MsrProto;
+
+/////////////////////////////////////////////////////////////////////////////
+History::History(const Server *server, const PdServ::Config& config):
+    server(server)
+{
+    // Memory per channel in kB
+    size_t memory = config["memory"].toUInt(256) * 1024;
+    PdServ::Config list(config["channels"]);
+
+    for (size_t i = 0; list[i]; ++i) {
+        std::string path(list[i].toString());
+        const Channel *c = server->find<Channel>(path);
+
+        // Server side channels like TaskTime cannot be received
+        if (!c or dynamic_cast<const PdServ::Signal*>(c)
+                or !c->dim.isScalar() or !c->dtype.isPrimary()) {
+            LOG4CPLUS_WARN(server->log,
+                    LOG4CPLUS_TEXT("History requires a scalar signal: ")
+                    << LOG4CPLUS_STRING_TO_TSTRING(path));
+            continue;
+        }
+
+        if (rings.find(c) != rings.end())
+            continue;
+
+        Consumer*& consumer = consumers[c->signal->task];
+        if (!consumer)
+            consumer = new Consumer(c->signal->task);
+
+        Consumer::Entry entry = {c, new HistoryRing(memory, c->memSize), false};
+        consumer->entries.push_back(entry);
+        rings[c] = entry.ring;
+
+        c->signal->subscribe(consumer);
+
+        LOG4CPLUS_DEBUG(server->log,
+                LOG4CPLUS_TEXT("Keeping history of ")
+                << LOG4CPLUS_STRING_TO_TSTRING(path));
+    }
+
+    if (!rings.empty())
+        start();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+History::~History()
+{
+    terminate();
+
+    for (ConsumerMap::iterator it = consumers.begin();
+            it != consumers.end(); ++it)
+        delete it->second;
+
+    for (RingMap::iterator it = rings.begin(); it != rings.end(); ++it)
+        delete it->second;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool History::empty() const
+{
+    return rings.empty();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const HistoryRing *History::find(const Channel *c) const
+{
+    // The map is not changed after construction
+    RingMap::const_iterator it = rings.find(c);
+    return it != rings.end() ? it->second : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void History::run()
+{
+    // The PDO buffer holds a few seconds of data, so polling often
+    // enough is sufficient
+    for (;;) {
+        for (ConsumerMap::iterator it = consumers.begin();
+                it != consumers.end(); ++it)
+            it->second->poll();
+
+        Thread::sleep(50);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+History::Consumer::Consumer(const PdServ::Task *task):
+    PdServ::SessionTask(task)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void History::Consumer::newSignal(const PdServ::Signal *s)
+{
+    for (std::vector<Entry>::iterator it = entries.begin();
+            it != entries.end(); ++it)
+        if (it->channel->signal == s)
+            it->active = true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void History::Consumer::poll()
+{
+    const struct timespec *taskTime;
+    const PdServ::TaskStatistics *taskStatistics;
+
+    while (task->rxPdo(this, &taskTime, &taskStatistics)) {
+        const uint64_t time =
+            1000000000ULL * taskTime->tv_sec + taskTime->tv_nsec;
+
+        for (std::vector<Entry>::const_iterator it = entries.begin();
+                it != entries.end(); ++it) {
+            if (it->active)
+                it->ring->append(time,
+                        it->channel->signal->getValue(this)
+                        + it->channel->offset);
+        }
+    }
+}
@@ -0,0 +1,90 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef MSRHISTORY_H
+#define MSRHISTORY_H
+
+#include <map>
+#include <vector>
+#include <cc++/thread.h>
+
+#include "../SessionTask.h"
+
+namespace PdServ {
+    class Config;
+    class Task;
+}
+
+namespace MsrProto {
+
+class Server;
+class Channel;
+class HistoryRing;
+
+/* Server wide history of configured channels.
+ *
+ * A dedicated thread receives the PDOs of every task involved and
+ * appends the channel values to a HistoryRing per channel. Sessions
+ * read the rings without locking.
+ */
+class History: public ost::Thread {
+    public:
+        History(const Server *server, const PdServ::Config& config);
+        ~History();
+
+        // Returns 0 if the channel has no history
+        const HistoryRing *find(const Channel *c) const;
+
+        bool empty() const;
+
+    private:
+        const Server * const server;
+
+        struct Consumer: PdServ::SessionTask {
+            Consumer(const PdServ::Task *task);
+
+            struct Entry {
+                const Channel *channel;
+                HistoryRing *ring;
+                bool active;
+            };
+            std::vector<Entry> entries;
+
+            void poll();
+
+            // Reimplemented from PdServ::SessionTask
+            void newSignal(const PdServ::Signal *);
+        };
+
+        typedef std::map<const PdServ::Task*, Consumer*> ConsumerMap;
+        ConsumerMap consumers;
+
+        typedef std::map<const Channel*, HistoryRing*> RingMap;
+        RingMap rings;
+
+        // Reimplemented from ost::Thread
+        void run();
+};
+
+}
+#endif //MSRHISTORY_H
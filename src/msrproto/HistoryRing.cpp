@@ -0,0 +1,344 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "HistoryRing.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace MsrProto;
+
+// Worst case size of a compressed sample:
+// time: 4 bit header + 64 bit; value: 2 + 6 + 6 bit header + 64 bit
+static const size_t maxSampleBits = 4 + 64 + 2 + 6 + 6 + 64;
+
+/////////////////////////////////////////////////////////////////////////////
+// Decodes a bit stream written by HistoryRing::put()
+namespace {
+    struct Decoder {
+        Decoder(const uint64_t *data, size_t size):
+            data(data), size(size), pos(0), overrun(false) {
+        }
+
+        uint64_t get(unsigned int n) {
+            // The data may be garbage when the block is recycled
+            // while being read
+            if (pos + n > size) {
+                overrun = true;
+                return 0;
+            }
+
+            unsigned int used = pos % 64;
+            unsigned int free = 64 - used;
+            uint64_t w = data[pos / 64];
+            uint64_t v;
+
+            if (n <= free)
+                v = (w << used) >> (64 - n);
+            else {
+                unsigned int n2 = n - free;
+                v = (((w << used) >> used) << n2)
+                    | (data[pos / 64 + 1] >> (64 - n2));
+            }
+
+            pos += n;
+            return v;
+        }
+
+        int64_t getSigned(unsigned int n) {
+            return static_cast<int64_t>(get(n) << (64 - n)) >> (64 - n);
+        }
+
+        const uint64_t * const data;
+        const size_t size;
+        size_t pos;
+        bool overrun;
+    };
+}
+
+/////////////////////////////////////////////////////////////////////////////
+HistoryRing::HistoryRing(size_t memory, size_t valueSize):
+    valueSize(std::min(valueSize, sizeof(uint64_t))),
+    blocks(new Block[std::max(memory / sizeof(Block), size_t(2))]),
+    blockCount(std::max(memory / sizeof(Block), size_t(2)))
+{
+    for (size_t i = 0; i < blockCount; ++i) {
+        blocks[i].generation = 0;
+        blocks[i].seq = ~0UL;
+        blocks[i].bits = 0;
+    }
+
+    sequence = 0;
+    block = 0;
+    pos = 0;
+    word = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+HistoryRing::~HistoryRing()
+{
+    delete[] blocks;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void HistoryRing::nextBlock()
+{
+    block = &blocks[sequence % blockCount];
+
+    // Readers skip the block while the generation is odd and discard
+    // what they read when it changed
+    block->generation = block->generation + 1;
+    __sync_synchronize();
+
+    block->bits = 0;
+    block->seq = sequence;
+    __sync_synchronize();
+
+    block->generation = block->generation + 1;
+    __sync_synchronize();
+
+    sequence = sequence + 1;
+
+    pos = 0;
+    word = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void HistoryRing::put(uint64_t value, unsigned int n)
+{
+    unsigned int free = 64 - pos % 64;
+
+    if (n < 64)
+        value &= (uint64_t(1) << n) - 1;
+
+    if (n <= free) {
+        word |= n < 64 ? value << (free - n) : value;
+        block->data[pos / 64] = word;
+    }
+    else {
+        unsigned int n2 = n - free;
+        word |= value >> n2;
+        block->data[pos / 64] = word;
+
+        word = value << (64 - n2);
+        block->data[pos / 64 + 1] = word;
+    }
+
+    pos += n;
+    if (!(pos % 64))
+        word = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Time is stored as the difference of successive deltas
+void HistoryRing::putTime(uint64_t time)
+{
+    uint64_t delta = time - prevTime;
+    int64_t dod = static_cast<int64_t>(delta - prevDelta);
+
+    if (!dod)
+        put(0, 1);
+    else if (dod >= -(1LL << 13) and dod < (1LL << 13)) {
+        put(2, 2);
+        put(dod, 14);
+    }
+    else if (dod >= -(1LL << 19) and dod < (1LL << 19)) {
+        put(6, 3);
+        put(dod, 20);
+    }
+    else if (dod >= -(1LL << 31) and dod < (1LL << 31)) {
+        put(14, 4);
+        put(dod, 32);
+    }
+    else {
+        put(15, 4);
+        put(dod, 64);
+    }
+
+    prevTime = time;
+    prevDelta = delta;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// The value is stored as XOR with the previous value. Only the
+// meaningful bits are stored, reusing the previous window of leading and
+// trailing zeros if possible
+void HistoryRing::putValue(uint64_t value)
+{
+    uint64_t x = value ^ prevValue;
+    prevValue = value;
+
+    if (!x) {
+        put(0, 1);
+        return;
+    }
+
+    unsigned int l = __builtin_clzll(x);
+    unsigned int t = __builtin_ctzll(x);
+
+    if (lead < 64 and l >= lead and t >= trail) {
+        put(2, 2);
+        put(x >> trail, 64 - lead - trail);
+    }
+    else {
+        unsigned int len = 64 - l - t;
+
+        put(3, 2);
+        put(l, 6);
+        put(len - 1, 6);
+        put(x >> t, len);
+
+        lead = l;
+        trail = t;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void HistoryRing::append(uint64_t time, const char *value)
+{
+    uint64_t v = 0;
+    std::memcpy(&v, value, valueSize);
+
+    if (!block or pos + maxSampleBits > blockWords * 64)
+        nextBlock();
+
+    if (!pos) {
+        // Every block starts with a raw sample
+        put(time, 64);
+        put(v, 64);
+
+        prevTime = time;
+        prevDelta = 0;
+        prevValue = v;
+        lead = 64;
+        trail = 0;
+    }
+    else {
+        putTime(time);
+        putValue(v);
+    }
+
+    // Publish sample
+    __sync_synchronize();
+    block->bits = pos;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void HistoryRing::decode(const Block *block, size_t bits, uint64_t since,
+        std::vector<uint64_t>& time, std::vector<uint64_t>& value)
+{
+    Decoder d(block->data, std::min(bits, blockWords * 64));
+
+    if (bits < 128)
+        return;
+
+    uint64_t t = d.get(64);
+    uint64_t v = d.get(64);
+    uint64_t delta = 0;
+    unsigned int lead = 64, trail = 0;
+
+    while (!d.overrun) {
+        if (t >= since) {
+            time.push_back(t);
+            value.push_back(v);
+        }
+
+        if (d.pos >= bits)
+            break;
+
+        // Time
+        int64_t dod;
+        if (!d.get(1))
+            dod = 0;
+        else if (!d.get(1))
+            dod = d.getSigned(14);
+        else if (!d.get(1))
+            dod = d.getSigned(20);
+        else if (!d.get(1))
+            dod = d.getSigned(32);
+        else
+            dod = d.get(64);
+
+        delta += dod;
+        t += delta;
+
+        // Value
+        if (d.get(1)) {
+            if (d.get(1)) {
+                lead = d.get(6);
+                trail = 64 - lead - (d.get(6) + 1);
+            }
+
+            // Protect against garbage
+            if (lead + trail >= 64)
+                break;
+
+            v ^= d.get(64 - lead - trail) << trail;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+size_t HistoryRing::read(uint64_t since, size_t reduction,
+        std::vector<uint64_t>& time, std::vector<char>& value) const
+{
+    std::vector<uint64_t> t, v;
+    size_t count = 0, n = 0;
+
+    unsigned long s = sequence;
+    __sync_synchronize();
+
+    for (unsigned long k = s > blockCount ? s - blockCount : 0; k < s; ++k) {
+        const Block *b = &blocks[k % blockCount];
+
+        unsigned int generation = b->generation;
+        __sync_synchronize();
+        if ((generation & 1) or b->seq != k)
+            continue;
+
+        size_t bits = b->bits;
+        __sync_synchronize();
+
+        t.clear();
+        v.clear();
+        decode(b, bits, since, t, v);
+
+        // Discard the block if it was recycled meanwhile
+        __sync_synchronize();
+        if (b->generation != generation)
+            continue;
+
+        for (size_t i = 0; i < t.size(); ++i) {
+            if (n++ % reduction)
+                continue;
+
+            time.push_back(t[i]);
+
+            const char *p = reinterpret_cast<const char*>(&v[i]);
+            value.insert(value.end(), p, p + valueSize);
+            ++count;
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,93 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef HISTORYRING_H
+#define HISTORYRING_H
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+namespace MsrProto {
+
+/* Compressed history of a scalar channel in a fixed amount of memory.
+ *
+ * Samples are stored in a ring of blocks. Every block starts with a raw
+ * sample, the following ones are compressed: the time as the delta of
+ * the previous delta, the value as the XOR with the previous value
+ * (Gorilla encoding). When the ring is full, the oldest block is
+ * recycled.
+ *
+ * There is exactly one writer calling append(). Any number of readers
+ * may call read() concurrently without locking; blocks that were
+ * recycled while being read are skipped.
+ */
+class HistoryRing {
+    public:
+        // memory: bytes for the ring
+        // valueSize: size of a value, at most 8 bytes
+        HistoryRing(size_t memory, size_t valueSize);
+        ~HistoryRing();
+
+        const size_t valueSize;
+
+        void append(uint64_t time, const char *value);
+
+        // Collect every reduction'th sample not older than since.
+        // Returns the number of samples
+        size_t read(uint64_t since, size_t reduction,
+                std::vector<uint64_t>& time,
+                std::vector<char>& value) const;
+
+    private:
+        static const size_t blockWords = 256;
+
+        struct Block {
+            volatile unsigned int generation;   // Odd while recycled
+            volatile unsigned long seq;         // Number of the block
+            volatile size_t bits;               // Valid bits in data
+            uint64_t data[blockWords];
+        };
+
+        Block * const blocks;
+        const size_t blockCount;
+        volatile unsigned long sequence;        // Blocks started
+
+        // Encoder state of the writer
+        Block *block;
+        size_t pos;
+        uint64_t word;
+        uint64_t prevTime, prevDelta, prevValue;
+        unsigned int lead, trail;
+
+        void nextBlock();
+        void put(uint64_t value, unsigned int n);
+        void putTime(uint64_t time);
+        void putValue(uint64_t value);
+
+        static void decode(const Block *block, size_t bits, uint64_t since,
+                std::vector<uint64_t>& time, std::vector<uint64_t>& value);
+};
+
+}
+#endif //HISTORYRING_H
@@ -30,8 +30,8 @@
 using namespace MsrProto;
 
 /////////////////////////////////////////////////////////////////////////////
-HyperDirNode::HyperDirNode(DirectoryNode* parent, const std::string* name):
-    DirectoryNode(parent, *name)
+HyperDirNode::HyperDirNode(DirectoryNode* parent, const char* name):
+    DirectoryNode(parent, name)
 {
 }
 
@@ -30,7 +30,7 @@ namespace MsrProto {
 
 class HyperDirNode: public DirectoryNode {
     public:
-        HyperDirNode(DirectoryNode* parent, const std::string* name);
+        HyperDirNode(DirectoryNode* parent, const char* name);
         void insertLeaf(DirectoryNode* child);
 };
 
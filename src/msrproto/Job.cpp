@@ -0,0 +1,407 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "../Main.h"
+#include "../Session.h"
+#include "../ProcessParameter.h"
+#include "../Signal.h"
+#include "Job.h"
+#include "Channel.h"
+#include "Parameter.h"
+#include "DirectoryNode.h"
+
+#include <algorithm>
+#include <fnmatch.h>
+
+using namespace MsrProto;
+
+/////////////////////////////////////////////////////////////////////////////
+Job::Job(const char *name, const std::string& id, bool compact):
+    id(id), elementId(id), stream(&buf)
+{
+    stream.compact = compact;
+    element = new XmlElement(name, stream, 0, &elementId);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+Job::~Job()
+{
+    delete element;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool Job::step(size_t count)
+{
+    if (!element)
+        return true;
+
+    if (!generate(*element, count))
+        return false;
+
+    // Close the element
+    delete element;
+    element = 0;
+
+    stream.flush();
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+std::string Job::str() const
+{
+    return buf.str();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+ChannelListJob::ChannelListJob(const std::string& id, bool compact,
+        const VariableTable<Channel>& channels, bool shortReply):
+    Job("channels", id, compact),
+    channels(channels), shortReply(shortReply)
+{
+    index = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool ChannelListJob::generate(XmlElement& element, size_t count)
+{
+    for (; index < channels.size() and count; ++index, --count) {
+        // Elements are not kept for a listing
+        TempNode tmp;
+        const Channel *c = channels.get(index, tmp);
+        if (c->hidden)
+            continue;
+
+        XmlElement el(element.createChild("channel"));
+        c->setXmlAttributes(el, shortReply, 0, 16, 0);
+    }
+
+    return index == channels.size();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+ParameterSnapshot::ParameterSnapshot(PdServ::Session *session,
+        const VariableTable<Parameter>& parameters):
+    session(session), parameters(parameters)
+{
+    begin = 0;
+
+    while ((generation = session->main->getParameterGeneration()) & 1)
+        ost::Thread::yield();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void ParameterSnapshot::read(size_t begin, size_t end, unsigned int since)
+{
+    const PdServ::Main *main = session->main;
+    unsigned int generation;
+
+    this->begin = begin;
+
+    // Repeat the pass until no parameter changed meanwhile. A step is
+    // small, so that a pass is rarely disturbed more than once
+    for (;;) {
+        while ((generation = main->getParameterGeneration()) & 1)
+            ost::Thread::yield();
+
+        readPass(end, since);
+
+        if (generation == main->getParameterGeneration())
+            break;
+
+        ost::Thread::yield();
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void ParameterSnapshot::readPass(size_t end, unsigned int since)
+{
+    const PdServ::Parameter *mainParam = 0;
+    size_t n = end - begin;
+
+    data.clear();
+    offset.resize(n);
+    mtime.resize(n);
+    modified.resize(n);
+
+    // Parameters with the same main parameter are neighbours
+    for (size_t i = 0; i < n; ++i) {
+        const Parameter *p = parameters.variable(begin + i);
+
+        if (p->mainParam == mainParam) {
+            offset[i] = offset[i-1];
+            mtime[i] = mtime[i-1];
+            modified[i] = modified[i-1];
+            continue;
+        }
+
+        mainParam = p->mainParam;
+        modified[i] = static_cast<const PdServ::ProcessParameter*>(
+                mainParam)->getGeneration();
+        offset[i] = data.size();
+        if (since and modified[i] <= since)
+            continue;
+
+        data.resize(data.size() + mainParam->memSize);
+        mainParam->getValue(session, &data[offset[i]], &mtime[i]);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const char *ParameterSnapshot::value(size_t index) const
+{
+    return &data[offset[index - begin]];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const struct timespec& ParameterSnapshot::time(size_t index) const
+{
+    return mtime[index - begin];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+unsigned int ParameterSnapshot::changed(size_t index) const
+{
+    return modified[index - begin];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+ParameterListJob::ParameterListJob(const std::string& id, bool compact,
+        PdServ::Session *session,
+        const VariableTable<Parameter>& parameters,
+        bool shortReply, bool hex, unsigned int since):
+    Job("parameters", id, compact), parameters(parameters),
+    snapshot(session, parameters), shortReply(shortReply), hex(hex),
+    since(since)
+{
+    index = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool ParameterListJob::generate(XmlElement& element, size_t count)
+{
+    // The client uses the generation for the next request
+    if (!index)
+        XmlElement::Attribute(element, "generation") << snapshot.generation;
+
+    size_t end = index + std::min(parameters.size() - index, count);
+    snapshot.read(index, end, since);
+
+    for (; index < end; ++index) {
+        if (since and snapshot.changed(index) <= since)
+            continue;
+
+        // Elements are not kept for a listing
+        TempNode tmp;
+        const Parameter *p = parameters.get(index, tmp);
+        if (p->hidden)
+            continue;
+
+        XmlElement xml(element.createChild("parameter"));
+        p->setXmlAttributes(xml, snapshot.value(index),
+                snapshot.time(index), shortReply, hex, 16);
+    }
+
+    return index == parameters.size();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+ParameterValuesJob::ParameterValuesJob(const std::string& id, bool compact,
+        PdServ::Session *session,
+        const VariableTable<Parameter>& parameters):
+    Job("param_values", id, compact), parameters(parameters),
+    snapshot(session, parameters)
+{
+    index = 0;
+    values = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+ParameterValuesJob::~ParameterValuesJob()
+{
+    delete values;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool ParameterValuesJob::generate(XmlElement& element, size_t count)
+{
+    // The attribute stays open until all values are printed
+    if (!values)
+        values = new XmlElement::Attribute(element, "value");
+
+    // Values are printed per main parameter. Elements share the main
+    // parameter of their variable
+    size_t end = index;
+    for (; end < parameters.size() and count; --count) {
+        const PdServ::Parameter* mainParam =
+            parameters.variable(end)->mainParam;
+        while (end < parameters.size()
+                and mainParam == parameters.variable(end)->mainParam) {
+            const Parameter *p = parameters.variable(end);
+            end = p->index + 1 + p->elementCount();
+        }
+    }
+
+    snapshot.read(index, end);
+
+    while (index < end) {
+        const Parameter *p = parameters.variable(index);
+        if (!index or p->mainParam
+                != parameters.variable(index - 1)->mainParam) {
+            if (index)
+                *values << ';';
+            values->csv(p, snapshot.value(index), 1, 16);
+        }
+
+        index = p->index + 1 + p->elementCount();
+    }
+
+    if (index < parameters.size())
+        return false;
+
+    delete values;
+    values = 0;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+ListingJob::Options::Options():
+    depth(1), values(true), limit(0), regex(0)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+ListingJob::ListingJob(const std::string& id, bool compact,
+        PdServ::Session *session, const DirectoryNode *node,
+        const Options& options, const DirectoryNode *cursor):
+    Job("listing", id, compact), session(session), options(options),
+    walker(node ? new DirectoryNode::Walker(node, options.depth) : 0)
+{
+    reported = 0;
+
+    if (walker and cursor and !walker->seek(cursor)) {
+        delete walker;
+        walker = 0;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+ListingJob::~ListingJob()
+{
+    delete walker;
+
+    if (options.regex) {
+        ::regfree(options.regex);
+        delete options.regex;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool ListingJob::valid() const
+{
+    return walker;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool ListingJob::matches(const std::string& path) const
+{
+    if (!options.glob.empty()
+            and ::fnmatch(options.glob.c_str(), path.c_str(), 0))
+        return false;
+
+    return !options.regex
+        or !::regexec(options.regex, path.c_str(), 0, 0, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool ListingJob::report(XmlElement& element, const DirectoryNode *node) const
+{
+    const Parameter *param = dynamic_cast<const Parameter *>(node);
+    if (param) {
+        if (param->hidden)
+            return false;
+
+        XmlElement xml(element.createChild("parameter"));
+        if (options.values) {
+            char buf[param->mainParam->memSize];
+            struct timespec ts;
+
+            param->mainParam->getValue(session, buf, &ts);
+            param->setXmlAttributes(xml, buf, ts, 0, 0, 16);
+        }
+        else {
+            param->setAttributes(xml, false);
+            param->addCompoundFields(xml, param->variable->dtype);
+        }
+        return true;
+    }
+
+    const Channel *channel = dynamic_cast<const Channel *>(node);
+    if (channel) {
+        if (channel->hidden)
+            return false;
+
+        XmlElement xml(element.createChild("channel"));
+        channel->setXmlAttributes(xml, 0, 0, 0, 0);
+        return true;
+    }
+
+    XmlElement el(element.createChild("dir"));
+    XmlElement::Attribute(el, "path").setEscaped(walker->path());
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool ListingJob::generate(XmlElement& element, size_t count)
+{
+    if (!walker)
+        return true;
+
+    // count limits the nodes that are looked at, so that a filter that
+    // rejects most of them does not block the session
+    for (; count; --count) {
+        const DirectoryNode *node = walker->next();
+        if (!node)
+            return true;
+
+        if (!matches(walker->path()) or !report(element, node))
+            continue;
+
+        if (++reported == options.limit) {
+            // Tell the client where to continue
+            if (!walker->atEnd()) {
+                XmlElement el(element.createChild("cursor"));
+                XmlElement::Attribute(el, "path")
+                    .setEscaped(walker->path());
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
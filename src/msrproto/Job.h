@@ -0,0 +1,209 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef MSRJOB_H
+#define MSRJOB_H
+
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include <regex.h>
+
+#include "XmlStream.h"
+#include "XmlElement.h"
+#include "DirectoryNode.h"
+#include "Variable.h"
+
+namespace PdServ {
+    class Session;
+}
+
+namespace MsrProto {
+
+class Channel;
+class Parameter;
+/* Reply to a command that produces a lot of output, e.g. listing all
+ * channels.
+ *
+ * The reply is generated in steps of a limited number of items, so that
+ * the session can process data in between. It is collected in a private
+ * buffer and sent in one piece when finished, so that other tags are not
+ * interleaved with it.
+ */
+class Job {
+    public:
+        Job(const char *name, const std::string& id, bool compact);
+        virtual ~Job();
+
+        // Command id, used for the acknowledgement
+        const std::string id;
+
+        // Generate at most count items. Returns true when the reply
+        // is complete
+        bool step(size_t count);
+
+        // The complete reply
+        std::string str() const;
+
+    protected:
+        // Generate at most count children of element. Returns true when
+        // finished
+        virtual bool generate(XmlElement& element, size_t count) = 0;
+
+    private:
+        std::string elementId;
+        std::stringbuf buf;
+        XmlStream stream;
+        XmlElement *element;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// <rk>: all channels
+class ChannelListJob: public Job {
+    public:
+        ChannelListJob(const std::string& id, bool compact,
+                const VariableTable<Channel>& channels,
+                bool shortReply);
+
+    private:
+        const VariableTable<Channel>& channels;
+        const bool shortReply;
+        size_t index;
+
+        bool generate(XmlElement& element, size_t count);
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// Values of parameters, read step by step while a job runs, so that a
+// large model does not block the session. A step is read in a single
+// pass, which is repeated until no parameter changed meanwhile, so that
+// the values of a step are always consistent.
+class ParameterSnapshot {
+    public:
+        ParameterSnapshot(PdServ::Session *session,
+                const VariableTable<Parameter>& parameters);
+
+        // Parameter generation when the snapshot started. Parameters
+        // read later may be newer
+        unsigned int generation;
+
+        // Read parameters [begin, end). With since, those that did not
+        // change after that generation are skipped and not copied
+        void read(size_t begin, size_t end, unsigned int since = 0);
+
+        // Value of the main parameter of parameters[index], which must
+        // be within the range read last
+        const char *value(size_t index) const;
+        const struct timespec& time(size_t index) const;
+        unsigned int changed(size_t index) const;      // Generation
+
+    private:
+        PdServ::Session * const session;
+        const VariableTable<Parameter>& parameters;
+
+        size_t begin;                           // Of the range read
+        std::vector<char> data;
+        std::vector<size_t> offset;             // In data, per parameter
+        std::vector<struct timespec> mtime;     // Per parameter
+        std::vector<unsigned int> modified;     // Per parameter
+
+        void readPass(size_t end, unsigned int since);
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// <rp>: all parameters, or those changed after generation since
+class ParameterListJob: public Job {
+    public:
+        ParameterListJob(const std::string& id, bool compact,
+                PdServ::Session *session,
+                const VariableTable<Parameter>& parameters,
+                bool shortReply, bool hex, unsigned int since = 0);
+
+    private:
+        const VariableTable<Parameter>& parameters;
+        ParameterSnapshot snapshot;
+        const bool shortReply;
+        const bool hex;
+        const unsigned int since;
+        size_t index;
+
+        bool generate(XmlElement& element, size_t count);
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// <rpv>: values of all parameters in a single attribute
+class ParameterValuesJob: public Job {
+    public:
+        ParameterValuesJob(const std::string& id, bool compact,
+                PdServ::Session *session,
+                const VariableTable<Parameter>& parameters);
+        ~ParameterValuesJob();
+
+    private:
+        const VariableTable<Parameter>& parameters;
+        ParameterSnapshot snapshot;
+        size_t index;
+        XmlElement::Attribute *values;
+
+        bool generate(XmlElement& element, size_t count);
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// <list>: contents of a directory, optionally of several levels and
+// filtered by path
+class ListingJob: public Job {
+    public:
+        struct Options {
+            Options();
+
+            size_t depth;       // Levels to descend, 0 is unlimited
+            bool values;        // Report values of parameters
+            size_t limit;       // Entries in the reply, 0 is unlimited
+            std::string glob;   // fnmatch(3) pattern for the path
+            regex_t *regex;     // Pattern for the path; owned by the job
+        };
+
+        // With cursor, the listing continues after that node
+        ListingJob(const std::string& id, bool compact,
+                PdServ::Session *session, const DirectoryNode *node,
+                const Options& options, const DirectoryNode *cursor = 0);
+        ~ListingJob();
+
+        // False if the cursor is not part of the listing
+        bool valid() const;
+
+    private:
+        PdServ::Session * const session;
+        const Options options;
+        DirectoryNode::Walker *walker;
+        size_t reported;
+
+        bool matches(const std::string& path) const;
+        bool report(XmlElement& element, const DirectoryNode *node) const;
+
+        bool generate(XmlElement& element, size_t count);
+};
+
+}
+#endif //MSRJOB_H
@@ -0,0 +1,94 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include "MessageRing.h"
+#include "../SharedBuffer.h"
+
+using namespace MsrProto;
+
+/////////////////////////////////////////////////////////////////////////////
+MessageRing::MessageRing(size_t size):
+    messages(new Message[size]), size(size)
+{
+    for (size_t i = 0; i < size; ++i)
+        messages[i].buffer = 0;
+
+    position = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+MessageRing::~MessageRing()
+{
+    for (size_t i = 0; i < size; ++i)
+        if (messages[i].buffer)
+            messages[i].buffer->unref();
+
+    delete[] messages;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+unsigned int MessageRing::head() const
+{
+    return position;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void MessageRing::append(PdServ::SharedBuffer* buffer, size_t split,
+        bool intrusive)
+{
+    ost::MutexLock lock(mutex);
+
+    Message& m = messages[position % size];
+    if (m.buffer)
+        m.buffer->unref();
+
+    m.buffer = buffer;
+    m.split = split;
+    m.intrusive = intrusive;
+
+    position = position + 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+size_t MessageRing::read(unsigned int& pos, std::vector<Message>& list) const
+{
+    // Most of the time there is nothing new. This is checked without
+    // taking the lock
+    if (pos == position)
+        return 0;
+
+    ost::MutexLock lock(mutex);
+
+    size_t lost = 0;
+    if (position - pos > size) {
+        lost = position - pos - size;
+        pos = position - size;
+    }
+
+    for (; pos != position; ++pos) {
+        Message m = messages[pos % size];
+        m.buffer->ref();
+        list.push_back(m);
+    }
+
+    return lost;
+}
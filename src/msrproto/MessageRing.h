@@ -0,0 +1,78 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#ifndef MESSAGERING_H
+#define MESSAGERING_H
+
+#include <cstddef>
+#include <vector>
+#include <cc++/thread.h>
+
+namespace PdServ {
+    class SharedBuffer;
+}
+
+namespace MsrProto {
+
+/* Ring of preformatted messages that are sent to every session, e.g.
+ * <broadcast> and events.
+ *
+ * A message is formatted once into a reference counted buffer that
+ * all sessions queue for output without copying. Every session keeps
+ * its own cursor. Messages that were overwritten before a session
+ * read them are lost for that session.
+ */
+class MessageRing {
+    public:
+        MessageRing(size_t size = 256);
+        ~MessageRing();
+
+        struct Message {
+            PdServ::SharedBuffer* buffer;
+            size_t split;       // Normal format is [0, split),
+                                // compact format is [split, size)
+            bool intrusive;     // Not sent to polite sessions
+        };
+
+        // Takes over the reference to the buffer
+        void append(PdServ::SharedBuffer* buffer, size_t split,
+                bool intrusive);
+
+        // Position of the next message to be written
+        unsigned int head() const;
+
+        // Append references to the messages [pos, head()) to list,
+        // advancing pos to head(). Returns the number of lost messages.
+        // The caller has to unref() the buffers
+        size_t read(unsigned int& pos, std::vector<Message>& list) const;
+
+    private:
+        Message * const messages;
+        const size_t size;
+        volatile unsigned int position;
+
+        mutable ost::Mutex mutex;
+};
+
+}
+
+#endif // MESSAGERING_H
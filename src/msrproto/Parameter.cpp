@@ -24,11 +24,13 @@
 #include "Parameter.h"
 #include "XmlElement.h"
 #include "Session.h"
+#include "ValueDecoder.h"
 #include "../Parameter.h"
 #include "../Debug.h"
 #include "../DataType.h"
 
 #include <sstream>
+#include <algorithm>
 #include <cerrno>
 #include <stdint.h>
 
@@ -70,21 +72,31 @@ Parameter::Parameter(const PdServ::Parameter *p, size_t index,
 }
 
 /////////////////////////////////////////////////////////////////////////////
-bool Parameter::inform(Session* session, size_t begin, size_t end) const
+Parameter::Parameter(const Parameter* parent, size_t n):
+    Variable(parent, n),
+    mainParam(parent->mainParam),
+    persistent(parent->persistent),
+    dependent(true)
 {
-    if (begin >= offset + memSize)
-        return false;
-    else if (offset >= end)
-        return true;
+}
 
-    session->parameterChanged(this);
-    for (List::const_iterator it = children.begin();
-            it != children.end(); ++it) {
-        if ((*it)->inform(session, begin, end))
-            break;
-    }
+/////////////////////////////////////////////////////////////////////////////
+Variable* Parameter::createElement(size_t n) const
+{
+    return new Parameter(this, n);
+}
 
-    return false;
+/////////////////////////////////////////////////////////////////////////////
+void Parameter::inform(Session* session, size_t begin, size_t end) const
+{
+    if (begin < offset + memSize and offset < end)
+        session->parameterChanged(this,
+                std::max(begin, offset) - offset,
+                std::min(end, offset + memSize) - offset);
+
+    for (List::const_iterator it = children.begin();
+            it != children.end(); ++it)
+        (*it)->inform(session, begin, end);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -94,30 +106,46 @@ void Parameter::addChild(const Parameter* child)
 }
 
 /////////////////////////////////////////////////////////////////////////////
-void Parameter::setXmlAttributes(XmlElement &element, const char *valueBuf,
-        struct timespec const& mtime, bool shortReply, bool hex,
-        std::streamsize precision) const
+void Parameter::setStaticAttributes(XmlElement &element) const
 {
     unsigned int flags = MSR_R | MSR_W | MSR_WOP;
 
+    XmlElement::Attribute(element, "flags")
+        << flags + (dependent ? 0x100 : 0);
+
+    // persistent=
+    if (persistent)
+        XmlElement::Attribute(element, "persistent") << 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Parameter::setXmlAttributes(XmlElement &element, const char *valueBuf,
+        struct timespec const& mtime, bool shortReply, bool hex,
+        std::streamsize precision, size_t startindex, size_t count) const
+{
     // <parameter name="/lan/Control/EPC/EnableMotor/Value/2"
     //            index="30" value="0"/>
 
     setAttributes(element, shortReply);
 
-    if (!shortReply) {
-        XmlElement::Attribute(element, "flags")
-            << flags + (dependent ? 0x100 : 0);
-
-        // persistent=
-        if (persistent)
-            XmlElement::Attribute(element, "persistent") << 1;
-    }
-
     // mtime=
     XmlElement::Attribute(element, "mtime") << mtime;
 
-    if (valueBuf) {
+    if (valueBuf and count < dim.nelem) {
+        // Slice of elements
+        const char *p = valueBuf + offset + startindex * dtype.size;
+
+        XmlElement::Attribute(element, "startindex") << startindex;
+        XmlElement::Attribute(element, "count") << count;
+
+        if (hex)
+            XmlElement::Attribute(element, "hexvalue")
+                .hexDec(p, count * dtype.size);
+        else
+            XmlElement::Attribute(element, "value")
+                .csv(dtype, p, count, precision);
+    }
+    else if (valueBuf) {
         if (hex)
             XmlElement::Attribute(element, "hexvalue")
                 .hexDec(valueBuf + offset, memSize);
@@ -132,6 +160,30 @@ void Parameter::setXmlAttributes(XmlElement &element, const char *valueBuf,
     return;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+void Parameter::setBase64Value(XmlElement &element, const char *valueBuf,
+        size_t startindex, size_t count,
+        const PdServ::DataType& wire, bool swap) const
+{
+    std::vector<char> data(count * wire.size);
+
+    if (count < dim.nelem) {
+        XmlElement::Attribute(element, "startindex") << startindex;
+        XmlElement::Attribute(element, "count") << count;
+    }
+
+    if (count) {
+        ValueDecoder::convert(dtype,
+                valueBuf + offset + startindex * dtype.size,
+                wire, &data[0], count);
+        if (swap)
+            ValueDecoder::swapBytes(&data[0], wire.size, count);
+    }
+
+    XmlElement::Attribute(element, "base64value")
+        .base64(count ? &data[0] : 0, data.size());
+}
+
 /////////////////////////////////////////////////////////////////////////////
 int Parameter::setHexValue(const Session *session,
         const char *s, size_t startindex) const
@@ -160,6 +212,19 @@ int Parameter::setHexValue(const Session *session,
             offset + startindex * dtype.size, c - valueBuf);
 }
 
+/////////////////////////////////////////////////////////////////////////////
+int Parameter::setRawValue(const Session *session,
+        const char *buf, size_t size, size_t startindex) const
+{
+    size_t start = startindex * dtype.size;
+
+    if (start >= memSize)
+        return -EINVAL;
+
+    return mainParam->setValue(session, buf, offset + start,
+            std::min(size, memSize - start));
+}
+
 /////////////////////////////////////////////////////////////////////////////
 int Parameter::setElements(std::istream& is,
         const PdServ::DataType& dtype, const PdServ::DataType::DimType& dim,
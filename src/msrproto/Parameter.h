@@ -26,6 +26,8 @@
 
 #include "Variable.h"
 
+#include <list>
+
 namespace PdServ {
     class Parameter;
     class DataType;
@@ -43,17 +45,32 @@ class Parameter: public Variable {
                 const PdServ::DataType::DimType& dim,
                 size_t offset, Parameter* parent);
 
+        // With count < dim.nelem, only the elements
+        // [startindex, startindex + count) are printed
         void setXmlAttributes(XmlElement&, const char *buf,
                 struct timespec const& ts, bool shortReply,
-                bool hex, std::streamsize precision) const;
+                bool hex, std::streamsize precision,
+                size_t startindex = 0, size_t count = ~0U) const;
+
+        // Set base64value to the elements [startindex, startindex + count)
+        // as raw data of type wire, byte swapped if required
+        void setBase64Value(XmlElement&, const char *buf,
+                size_t startindex, size_t count,
+                const PdServ::DataType& wire, bool swap) const;
 
-        bool inform(Session* session, size_t begin, size_t end) const;
+        // Report a change of the bytes [begin, end) of the main
+        // parameter for this parameter and the following fields of a
+        // compound parameter. The elements of a split parameter are
+        // covered by the parameter itself
+        void inform(Session* session, size_t begin, size_t end) const;
         void addChild(const Parameter* child);
 
         int setHexValue(const Session *,
                 const char *str, size_t startindex) const;
         int setDoubleValue(const Session *,
                 const char *, size_t startindex) const;
+        int setRawValue(const Session *,
+                const char *buf, size_t size, size_t startindex) const;
 
         const PdServ::Parameter * const mainParam;
         bool persistent;
@@ -61,6 +78,13 @@ class Parameter: public Variable {
     private:
         const bool dependent;
 
+        // View of element n of a split parameter
+        Parameter(const Parameter* parent, size_t n);
+
+        // Reimplemented from Variable
+        void setStaticAttributes(XmlElement &element) const;
+        Variable* createElement(size_t n) const;
+
         int setElements(std::istream& is,
                 const PdServ::DataType& dtype,
                 const PdServ::DataType::DimType& dim,
@@ -29,6 +29,10 @@
 #include "StatSignal.h"
 #include "Parameter.h"
 #include "Session.h"
+#include "History.h"
+#include "Event.h"
+#include "XmlElement.h"
+#include "../SharedBuffer.h"
 #include "../Main.h"
 #include "../Task.h"
 #include "../Signal.h"
@@ -36,6 +40,7 @@
 
 #include <cerrno>
 #include <algorithm>
+#include <sstream>
 #include <cc++/socketport.h>
 #include <log4cplus/loggingmacros.h>
 
@@ -63,12 +68,37 @@ Server::Server(const PdServ::Main *main, const PdServ::Config &config):
 
     maxConnections = config["maxconnections"].toUInt(~0U);
 
+    outputBudget = config["outputbudget"].toUInt(4U << 20);
+    std::string policy = config["backpressure"].toString("drop");
+    if (policy == "reduce")
+        backpressure = RaiseReduction;
+    else if (policy == "disconnect")
+        backpressure = Disconnect;
+    else {
+        if (policy != "drop")
+            LOG4CPLUS_WARN(log,
+                    LOG4CPLUS_TEXT("Unknown backpressure policy ")
+                    << LOG4CPLUS_STRING_TO_TSTRING(policy)
+                    << LOG4CPLUS_TEXT("; dropping data frames instead"));
+        backpressure = DropFrames;
+    }
+
     for (std::list<const PdServ::Task*> taskList(main->getTasks());
             taskList.size(); taskList.pop_front())
         createChannels(insertRoot, taskList.front());
 
     createParameters(insertRoot);
 
+    // The tree is complete now; nodes may have been renamed while it grew
+    variableDirectory.compact(nodeNames);
+
+    std::string prefix;
+    variableDirectory.index(variableIndex, prefix);
+
+    catalogue.build(channels, parameters);
+
+    history = new History(this, config["history"]);
+
     unsigned int bufLimit = config["parserbufferlimit"].toUInt();
     if (bufLimit and maxInputBufferSize > bufLimit)
         maxInputBufferSize = bufLimit;
@@ -85,6 +115,8 @@ Server::~Server()
 {
     terminate();
 
+    delete history;
+
     // Parameters and Channels are deleted when variable tree
     // is deleted
 }
@@ -101,7 +133,7 @@ void Server::createChannels(DirectoryNode* baseDir, const PdServ::Task* task)
     std::list<const PdServ::Signal*> signals(task->getSignals());
 
     // Reserve at least signal count and additionally 4 Taskinfo signals
-    channels.reserve(channels.size() + signals.size() + 4);
+    channels.reserve(channels.variables().size() + signals.size() + 4);
 
     for (; signals.size(); signals.pop_front()) {
         const PdServ::Signal *signal = signals.front();
@@ -144,7 +176,7 @@ void Server::createParameters(DirectoryNode* baseDir)
 
     std::list<const PdServ::Parameter*> mainParam(main->getParameters());
 
-    parameters.reserve(parameters.size() + mainParam.size());
+    parameters.reserve(parameters.variables().size() + mainParam.size());
 
     for (; mainParam.size(); mainParam.pop_front()) {
         const PdServ::Parameter *param = mainParam.front();
@@ -185,6 +217,24 @@ size_t Server::getMaxInputBufferSize() const
     return maxInputBufferSize;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+size_t Server::getOutputBudget() const
+{
+    return outputBudget;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+Server::Backpressure Server::getBackpressure() const
+{
+    return backpressure;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const HistoryRing *Server::getHistory(const Channel *c) const
+{
+    return history->find(c);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 void Server::initial()
 {
@@ -258,13 +308,72 @@ void Server::run()
 }
 
 /////////////////////////////////////////////////////////////////////////////
-void Server::broadcast(Session *s, const struct timespec& ts,
+void Server::broadcast(Session *, const struct timespec& ts,
         const std::string& action, const std::string &message)
 {
+    std::stringbuf buf;
+    XmlStream os(&buf);
+    size_t split = 0;
+
+    // Format normal and compact output once for all sessions
+    for (int compact = 0; compact < 2; ++compact) {
+        os.compact = compact;
+        {
+            XmlElement broadcast("broadcast", os, 0, 0);
+
+            XmlElement::Attribute(broadcast, "time") << ts;
+
+            if (!action.empty())
+                XmlElement::Attribute(broadcast, "action")
+                    .setEscaped(action);
+
+            if (!message.empty())
+                XmlElement::Attribute(broadcast, "text")
+                    .setEscaped(message);
+        }
+        os.flush();
+
+        if (!compact)
+            split = buf.str().size();
+    }
+
+    publish(buf.str(), split, true);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Server::newEvent(const PdServ::EventData& eventData)
+{
+    std::stringbuf buf;
+    XmlStream os(&buf);
+    size_t split = 0;
+
+    for (int compact = 0; compact < 2; ++compact) {
+        os.compact = compact;
+        Event::toXml(os, eventData);
+        os.flush();
+
+        if (!compact)
+            split = buf.str().size();
+    }
+
+    publish(buf.str(), split, false);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Server::publish(const std::string& message, size_t split,
+        bool intrusive)
+{
+    PdServ::SharedBuffer* buffer =
+        PdServ::SharedBuffer::create(message.size());
+    std::copy(message.begin(), message.end(), buffer->begin());
+
+    messages.append(buffer, split, intrusive);
+
+    // Wake up sessions waiting for input
     ost::MutexLock lock(mutex);
     for (std::set<Session*>::iterator it = sessions.begin();
             it != sessions.end(); ++it)
-        (*it)->broadcast(s, ts, action, message);
+        (*it)->wakeup();
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -300,12 +409,28 @@ void Server::setAic(const Parameter *p)
 void Server::parameterChanged(const PdServ::Parameter *mainParam,
         size_t offset, size_t count)
 {
-    const Parameter *p = find(mainParam);
+    // Sessions pick up the change from the log by themselves, so that
+    // the cost does not depend on the number of sessions
+    changeLog.append(find(mainParam), offset, offset + count,
+            main->getParameterGeneration());
+}
 
-    ost::MutexLock lock(mutex);
-    for (std::set<Session*>::iterator it = sessions.begin();
-            it != sessions.end(); ++it)
-        p->inform(*it, offset, offset + count);
+/////////////////////////////////////////////////////////////////////////////
+const ChangeLog& Server::getChangeLog() const
+{
+    return changeLog;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const Catalogue& Server::getCatalogue() const
+{
+    return catalogue;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const MessageRing& Server::getMessages() const
+{
+    return messages;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -321,10 +446,9 @@ const Server::Channels& Server::getChannels() const
 }
 
 /////////////////////////////////////////////////////////////////////////////
-void Server::listDir(PdServ::Session *session,
-        XmlElement& xml, const std::string& path) const
+const DirectoryNode* Server::getDirectory(const std::string& path) const
 {
-    variableDirectory.list(session, xml, path);
+    return variableDirectory.listNode(path);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -374,9 +498,17 @@ void Server::CreateVariable::newDimension(
         size_t /*dimIdx*/, size_t elemIdx,
         CreateVariable& /*c*/, size_t /*offset*/)
 {
-    std::ostringstream os;
-    os << elemIdx;
-    name = os.str();
+    // Called for every element of compound vectors; std::ostringstream
+    // would be a significant part of the startup time
+    char buf[20];
+    char* p = buf + sizeof(buf);
+
+    do {
+        *--p = '0' + elemIdx % 10;
+        elemIdx /= 10;
+    } while (elemIdx);
+
+    name.assign(p, buf + sizeof(buf));
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -387,27 +519,18 @@ void Server::CreateVariable::newField(const PdServ::DataType::Field* field,
 }
 
 /////////////////////////////////////////////////////////////////////////////
+// Every primary variable is created as a whole. The elements of split
+// variables are created on demand
 bool Server::CreateVariable::newVariable(
         const PdServ::DataType& dtype,
         const PdServ::DataType::DimType& dim,
-        size_t dimIdx, size_t elemIdx, size_t offset) const
+        size_t /*dimIdx*/, size_t /*elemIdx*/, size_t offset) const
 {
-    bool rv = false;
+    if (!dtype.isPrimary())
+        return false;
 
-    if (dtype.isPrimary()) {
-        if ((dimIdx == 0 and elemIdx == 0) or !server->itemize) {
-            // Root element of a primary variable
-            rv = createVariable(dtype, dim, offset);
-        }
-        else if (dimIdx == dim.size()) {
-            // Leaf node with only one element
-            static const size_t d = 1;
-            rv = createVariable(dtype,
-                    PdServ::DataType::DimType(1, &d), offset);
-        }
-    }
-
-    return rv;
+    createVariable(dtype, dim, offset);
+    return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -419,12 +542,11 @@ Server::CreateChannel::CreateChannel(
 }
 
 /////////////////////////////////////////////////////////////////////////////
-bool Server::CreateChannel::createVariable(const PdServ::DataType& dtype,
+void Server::CreateChannel::createVariable(const PdServ::DataType& dtype,
         const PdServ::DataType::DimType& dim, size_t offset) const
 {
     Channel *c = new Channel(static_cast<const PdServ::Signal*>(var),
             server->channels.size(), dtype, dim, offset);
-    bool rv;
 
     if (server->itemize) {
         char hidden = 0;
@@ -432,15 +554,13 @@ bool Server::CreateChannel::createVariable(const PdServ::DataType& dtype,
         baseDir->traditionalPathInsert(c, path(), hidden, persist);
         c->hidden = hidden == 'c' or hidden == 'k' or hidden == 1;
 
-        rv = c->hidden;
+        if (!c->hidden)
+            c->split();
     }
-    else {
+    else
         baseDir->pathInsert(c, path());
-        rv = true;
-    }
 
     server->channels.push_back(c);
-    return rv;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -452,14 +572,11 @@ Server::CreateParameter::CreateParameter(
 }
 
 /////////////////////////////////////////////////////////////////////////////
-bool Server::CreateParameter::createVariable(const PdServ::DataType& dtype,
+void Server::CreateParameter::createVariable(const PdServ::DataType& dtype,
         const PdServ::DataType::DimType& dim, size_t offset) const
 {
     Parameter *p = new Parameter(static_cast<const PdServ::Parameter*>(var),
             server->parameters.size(), dtype, dim, offset, parentParameter);
-    bool rv;
-
-    server->parameters.push_back(p);
 
     if (server->itemize) {
         char hidden = 0;
@@ -468,16 +585,18 @@ bool Server::CreateParameter::createVariable(const PdServ::DataType& dtype,
         p->hidden = hidden == 'p' or hidden == 1;
         p->persistent = persist;
 
-        rv = p->hidden;
+        if (!p->hidden)
+            p->split();
     }
-    else {
+    else
         baseDir->pathInsert(p, path());
-        rv = true;
-    }
 
-    if (!parentParameter)
-        server->parameterMap[static_cast<const PdServ::Parameter*>(var)] = p;
-    parentParameter = p;
+    server->parameters.push_back(p);
 
-    return rv;
+    // Changes are reported through the first field, which informs
+    // the others
+    if (!parentParameter) {
+        server->parameterMap[static_cast<const PdServ::Parameter*>(var)] = p;
+        parentParameter = p;
+    }
 }
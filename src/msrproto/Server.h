@@ -34,8 +34,13 @@
 #include "../Config.h"
 #include "../DataType.h"
 #include "DirectoryNode.h"
+#include "Variable.h"
+#include "ChangeLog.h"
+#include "Catalogue.h"
+#include "MessageRing.h"
 
 namespace PdServ {
+    struct EventData;
     class Main;
     class Task;
     class Parameter;
@@ -52,6 +57,8 @@ namespace MsrProto {
 class Session;
 class Parameter;
 class Channel;
+class History;
+class HistoryRing;
 
 class Server: public ost::Thread {
     public:
@@ -60,6 +67,7 @@ class Server: public ost::Thread {
 
         void broadcast(Session *s, const struct timespec& ts,
                 const std::string& action, const std::string& text);
+        void newEvent(const PdServ::EventData& eventData);
 
         void setAic(const Parameter*);
         void parameterChanged(const PdServ::Parameter*,
@@ -74,19 +82,35 @@ class Server: public ost::Thread {
         log4cplus::Logger log;
         const bool* const active;
 
-        typedef std::vector<const Channel*> Channels;
-        typedef std::vector<const Parameter*> Parameters;
+        typedef VariableTable<Channel> Channels;
+        typedef VariableTable<Parameter> Parameters;
 
         const Channels& getChannels() const;
         const Channel * getChannel(size_t) const;
-        void listDir(PdServ::Session *,
-                XmlElement& xml, const std::string& path) const;
+        const DirectoryNode* getDirectory(const std::string& path) const;
 
         const Parameters& getParameters() const;
         const Parameter * getParameter(size_t) const;
         const Parameter * find(const PdServ::Parameter *p) const;
         size_t getMaxInputBufferSize() const;
 
+        // Policy when the output queue of a session exceeds its budget
+        enum Backpressure {DropFrames, RaiseReduction, Disconnect};
+        size_t getOutputBudget() const;
+        Backpressure getBackpressure() const;
+
+        // Parameter changes, consumed by every session on its own
+        const ChangeLog& getChangeLog() const;
+
+        // Broadcasts and events, consumed by every session on its own
+        const MessageRing& getMessages() const;
+
+        // Binary description of all variables
+        const Catalogue& getCatalogue() const;
+
+        // Returns 0 if no history is kept for the channel
+        const HistoryRing * getHistory(const Channel *c) const;
+
         template <typename T>
             const T * find(const std::string& path) const;
 
@@ -97,15 +121,29 @@ class Server: public ost::Thread {
         bool itemize;   // Split multidimensional variables to scalars
         bool _active;
 
+        NameTable nodeNames;    // Must outlive variableDirectory
         DirectoryNode variableDirectory;
         DirectoryNode* insertRoot;
 
+        // Every path of variableDirectory, built once the tree is complete
+        DirectoryNode::Index variableIndex;
+
         size_t maxConnections;
         size_t maxInputBufferSize;
+        size_t outputBudget;
+        Backpressure backpressure;
 
         Channels channels;
         Parameters parameters;
 
+        History *history;
+
+        ChangeLog changeLog;
+        Catalogue catalogue;
+        MessageRing messages;
+        void publish(const std::string& message, size_t split,
+                bool intrusive);
+
         typedef std::map<const PdServ::Parameter *, const Parameter*>
             ParameterMap;
         ParameterMap parameterMap;
@@ -140,7 +178,7 @@ class Server: public ost::Thread {
                     const PdServ::DataType& dtype,
                     const PdServ::DataType::DimType& dim,
                     size_t dimIdx, size_t elemIdx, size_t offset) const;
-            virtual bool createVariable(
+            virtual void createVariable(
                     const PdServ::DataType& dtype,
                     const PdServ::DataType::DimType& dim,
                     size_t offset) const = 0;
@@ -159,7 +197,7 @@ class Server: public ost::Thread {
             CreateChannel(Server* server, DirectoryNode* baseDir,
                     const PdServ::Signal* s);
 
-            bool createVariable(
+            void createVariable(
                     const PdServ::DataType& dtype,
                     const PdServ::DataType::DimType& dim,
                     size_t offset) const;
@@ -169,11 +207,12 @@ class Server: public ost::Thread {
             CreateParameter(Server* server, DirectoryNode* baseDir,
                     const PdServ::Parameter* p);
 
-            bool createVariable(
+            void createVariable(
                     const PdServ::DataType& dtype,
                     const PdServ::DataType::DimType& dim,
                     size_t offset) const;
 
+            // First field of a compound parameter
             mutable Parameter* parentParameter;
         };
 };
@@ -185,7 +224,13 @@ const T *Server::find(const std::string &p) const
     if (p.empty() or p[0] != '/')
         return 0;
 
-    const DirectoryNode *node = variableDirectory.find(p, 1);
+    const DirectoryNode *node = variableIndex.find(p);
+
+    // Elements of split variables and paths with repeated or trailing
+    // separators are not indexed
+    if (!node)
+        node = variableDirectory.find(p, 1);
+
     return node ? dynamic_cast<const T*>(node) : 0;
 }
 
@@ -25,6 +25,10 @@
 #include <cerrno>       // ENAMETOOLONG
 #include <climits>      // HOST_NAME_MAX
 #include <unistd.h>     // gethostname
+#include <sys/socket.h> // sendmsg()
+#include <poll.h>       // poll()
+#include <fcntl.h>      // fcntl()
+#include <fnmatch.h>    // fnmatch()
 #include <log4cplus/ndc.h>
 #include <log4cplus/loggingmacros.h>
 
@@ -37,6 +41,7 @@
 #include "../Signal.h"
 #include "../Parameter.h"
 #include "../DataType.h"
+#include "../SharedBuffer.h"
 
 #include "Session.h"
 #include "Server.h"
@@ -46,6 +51,10 @@
 #include "XmlElement.h"
 #include "XmlParser.h"
 #include "SubscriptionManager.h"
+#include "Subscription.h"
+#include "Capture.h"
+#include "HistoryRing.h"
+#include "Job.h"
 
 using namespace MsrProto;
 
@@ -58,7 +67,13 @@ Session::Session( Server *server, ost::TCPSocket *socket):
     inBytes = 0;
     outBytes = 0;
 
+    congested = false;
+    reduction = 1;
+    droppedFrames = 0;
+
     timeTask = 0;
+    job = 0;
+    decodedParameter = 0;
 
     std::list<const PdServ::Task*> taskList(main->getTasks());
     subscriptionManager.reserve(taskList.size());
@@ -80,8 +95,18 @@ Session::Session( Server *server, ost::TCPSocket *socket):
     quiet = false;
     polite = false;
     aicDelay = 0;
+    changeLogPos = server->getChangeLog().head();
+    changeGeneration = main->getParameterGeneration() & ~1U;
+    messagePos = server->getMessages().head();
 
-    xmlstream.imbue(std::locale::classic());
+    woken = 0;
+    if (::pipe(wakePipe)) {
+        wakePipe[0] = wakePipe[1] = -1;
+    }
+    else {
+        ::fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+        ::fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+    }
 
     detach();
 }
@@ -91,6 +116,13 @@ Session::~Session()
 {
     server->sessionClosed(this);
 
+    if (wakePipe[0] >= 0) {
+        ::close(wakePipe[0]);
+        ::close(wakePipe[1]);
+    }
+
+    delete job;
+
     for (SubscriptionManagerVector::iterator it = subscriptionManager.begin();
             it != subscriptionManager.end(); ++it)
         delete *it;
@@ -107,6 +139,12 @@ void Session::getSessionStatistics(PdServ::SessionStatistics &stats) const
     stats.client = client;
     stats.countIn = inBytes;
     stats.countOut = outBytes;
+    stats.outputQueue = queuedBytes();
+    stats.outputQueueMax = queuedMax;
+    stats.droppedFrames = droppedFrames;
+    stats.compressIn = compressIn;
+    stats.compressOut = compressOut;
+    stats.compressTime = compressTime;
     stats.connectedTime = connectedTime;
 }
 
@@ -124,17 +162,77 @@ const PdServ::TaskStatistics *Session::getTaskStatistics (
 }
 
 /////////////////////////////////////////////////////////////////////////////
-void Session::broadcast(Session *, const struct timespec& ts,
-        const std::string& action, const std::string &message)
+void Session::wakeup()
 {
-    ost::MutexLock lock(mutex);
+    // Only write to the pipe once until the session has woken up
+    if (wakePipe[1] >= 0 and __sync_bool_compare_and_swap(&woken, 0, 1)) {
+        char c = 0;
+        if (::write(wakePipe[1], &c, 1) != 1)
+            woken = 0;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Wait at most timeout milliseconds for input. Returns true when input
+// is pending
+bool Session::waitInput(int timeout)
+{
+    struct pollfd fds[2];
+    nfds_t nfds = 1;
+
+    fds[0].fd = so;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+
+    if (wakePipe[0] >= 0) {
+        fds[1].fd = wakePipe[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        ++nfds;
+    }
+
+    if (::poll(fds, nfds, timeout) <= 0)
+        return false;
+
+    if (nfds > 1 and fds[1].revents) {
+        char buf[16];
+        woken = 0;
+        while (::read(wakePipe[0], buf, sizeof(buf)) > 0);
+    }
+
+    return fds[0].revents;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Session::readMessages()
+{
+    std::vector<MessageRing::Message> list;
+    size_t lost = server->getMessages().read(messagePos, list);
 
-    if (!polite) {
-        Broadcast *b = new Broadcast;
-        b->ts = ts;
-        b->action = action;
-        b->message = message;
-        broadcastList.push_back(b);
+    if (lost)
+        LOG4CPLUS_WARN(server->log,
+                LOG4CPLUS_TEXT("Lost ") << lost
+                << LOG4CPLUS_TEXT(" broadcasts and events"));
+
+    if (list.empty())
+        return;
+
+    // Keep the order of the output
+    xmlstream.flush();
+
+    for (std::vector<MessageRing::Message>::iterator it = list.begin();
+            it != list.end(); ++it) {
+        PdServ::SharedBuffer* buffer = it->buffer;
+
+        if (!(polite and it->intrusive)) {
+            if (xmlstream.compact)
+                queue(buffer, buffer->begin() + it->split, buffer->end());
+            else
+                queue(buffer, buffer->begin(),
+                        buffer->begin() + it->split);
+        }
+
+        buffer->unref();
     }
 }
 
@@ -150,11 +248,59 @@ void Session::setAIC(const Parameter *p)
 }
 
 /////////////////////////////////////////////////////////////////////////////
-void Session::parameterChanged(const Parameter *p)
+void Session::parameterChanged(const Parameter *p, size_t begin, size_t end)
 {
-    ost::MutexLock lock(mutex);
-    if (!polite)
-        changedParameter.insert(p);
+    size_t size = p->dtype.size;
+    ElementRange range(begin / size, (end + size - 1) / size);
+
+    // Coalesce with a pending change
+    std::pair<ParameterMap::iterator, bool> it =
+        changedParameter.insert(std::make_pair(p, range));
+    if (!it.second) {
+        ElementRange& r = it.first->second;
+        r.first  = std::min(r.first,  range.first);
+        r.second = std::max(r.second, range.second);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Session::readChangeLog()
+{
+    const ChangeLog& log = server->getChangeLog();
+    unsigned int head = log.head();
+
+    if (polite) {
+        changeLogPos = head;
+        return;
+    }
+
+    ChangeLog::Entry entry;
+    for (; changeLogPos != head; ++changeLogPos) {
+        int rv = log.read(changeLogPos, entry);
+
+        if (!rv) {
+            // Entry is still being written; continue next time
+            break;
+        }
+        else if (rv < 0) {
+            // Fell behind the log. Report everything
+            const std::vector<const Parameter*>& parameters =
+                server->getParameters().variables();
+            for (std::vector<const Parameter*>::const_iterator it =
+                    parameters.begin(); it != parameters.end(); ++it)
+                parameterChanged(*it, 0, (*it)->memSize);
+
+            changeLogPos = head;
+            changeGeneration = main->getParameterGeneration() & ~1U;
+            break;
+        }
+
+        entry.parameter->inform(this, entry.begin, entry.end);
+
+        // Concurrent writers may append slightly out of order
+        if (static_cast<int>(entry.generation - changeGeneration) > 0)
+            changeGeneration = entry.generation & ~1U;
+    }
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -184,9 +330,16 @@ void Session::initial()
         XmlElement::Attribute(greeting, "app") << main->name;
         XmlElement::Attribute(greeting, "appversion") << main->version;
         XmlElement::Attribute(greeting, "version") << MSR_VERSION;
+        XmlElement::Attribute(greeting, "generation")
+            << (main->getParameterGeneration() & ~1U);
+        XmlElement::Attribute(greeting, "catalogue")
+            << server->getCatalogue().hash();
         XmlElement::Attribute(greeting, "features") << MSR_FEATURES
 #ifdef GNUTLS_FOUND
             ",tls"
+#endif
+#ifdef ZLIB_FOUND
+            ",compress"
 #endif
             ;
         XmlElement::Attribute(greeting, "recievebufsize") << 100000000;
@@ -205,6 +358,7 @@ void Session::run()
 {
     XmlParser parser(
             std::max(server->getMaxInputBufferSize() + 1024UL, 8192UL));
+    parser.setValueStream(this);
 
     while (*server->active) {
         if (!xmlstream.good()) {
@@ -215,7 +369,8 @@ void Session::run()
 
         xmlstream.flush();
 
-        if (isPending(pendingInput, 40)) {
+        // Do not wait for input while a job is pending
+        if (waitInput(job ? 0 : 40)) {
             if (!parser.read(static_cast<PdServ::Session*>(this))) {
                 if (PdServ::Session::eof())
                     return;
@@ -231,24 +386,34 @@ void Session::run()
 //                        LOG4CPLUS_TEXT("Rx: ")
 //                        << LOG4CPLUS_STRING_TO_TSTRING(
 //                            std::string(inbuf.bufptr(), n)));
+        }
 
-            while (parser) {
-                parser.getString("id", commandId);
-                processCommand(&parser);
+        // Commands following a job are processed when it is finished
+        while (!job and parser) {
+            parser.getString("id", commandId);
+            processCommand(&parser);
 
-                if (!commandId.empty()) {
-                    XmlElement ack(createElement("ack"));
-                    XmlElement::Attribute(ack,"id")
-                        .setEscaped(commandId);
+            if (job) {
+                // The job sends the acknowledgement
+                commandId.clear();
+                runJob();
+            }
+            else if (!commandId.empty()) {
+                XmlElement ack(createElement("ack"));
+                XmlElement::Attribute(ack,"id")
+                    .setEscaped(commandId);
 
-                    commandId.clear();
-                }
+                commandId.clear();
             }
         }
 
+        if (job)
+            runJob();
+
+        readChangeLog();
+
         // Collect all asynchronous events while holding mutex
-        ParameterSet cp;
-        BroadcastList broadcastList;
+        ParameterMap cp;
         {
             // Create an environment for mutex lock. This lock should be kept
             // as short as possible, and especially not when writing to the
@@ -258,53 +423,101 @@ void Session::run()
             if (aicDelay)
                 --aicDelay;
 
-            ParameterSet::iterator it2, it = changedParameter.begin();
+            ParameterMap::iterator it2, it = changedParameter.begin();
             while (it != changedParameter.end()) {
                 it2 = it++;
-                if (!aicDelay or aic.find((*it2)->mainParam) == aic.end()) {
+                if (!aicDelay
+                        or aic.find(it2->first->mainParam) == aic.end()) {
                     cp.insert(*it2);
                     changedParameter.erase(it2);
                 }
             }
-
-            std::swap(this->broadcastList, broadcastList);
         }
 
         // Write all asynchronous events to the client
         {
-            for ( ParameterSet::iterator it = cp.begin();
+            for ( ParameterMap::iterator it = cp.begin();
                     it != cp.end(); ++it) {
-                XmlElement pu(createElement("pu"));
-                XmlElement::Attribute(pu, "index") << (*it)->index;
-            }
-
-            for ( BroadcastList::const_iterator it = broadcastList.begin();
-                    it != broadcastList.end(); ++it) {
-
-                XmlElement broadcast(createElement("broadcast"));
-
-                XmlElement::Attribute(broadcast, "time") << (*it)->ts;
-
-                if (!(*it)->action.empty())
-                    XmlElement::Attribute(broadcast, "action")
-                        .setEscaped((*it)->action);
+                const Parameter *p = it->first;
+                const ElementRange& range = it->second;
+
+                {
+                    XmlElement pu(createElement("pu"));
+                    XmlElement::Attribute(pu, "index") << p->index;
+
+                    // Changes up to this generation are reported. The
+                    // client can continue with <rp since=...> from here
+                    XmlElement::Attribute(pu, "generation")
+                        << changeGeneration;
+
+                    // Only a part of the parameter changed
+                    if (range.first or range.second < p->dim.nelem) {
+                        XmlElement::Attribute(pu, "startindex")
+                            << range.first;
+                        XmlElement::Attribute(pu, "count")
+                            << range.second - range.first;
+                    }
+                }
 
-                if (!(*it)->message.empty())
-                    XmlElement::Attribute(broadcast, "text")
-                        .setEscaped((*it)->message);
+                // The elements of a split parameter changed with it
+                for (size_t i = range.first;
+                        i < range.second and i < p->elementCount(); ++i) {
+                    XmlElement pu(createElement("pu"));
+                    XmlElement::Attribute(pu, "index") << p->index + 1 + i;
+                    XmlElement::Attribute(pu, "generation")
+                        << changeGeneration;
+                }
+            }
+        }
 
-                delete *it;
+        readMessages();
+
+        // Apply backpressure when the client does not keep up with
+        // the data stream
+        bool drop = false;
+        size_t budget = server->getOutputBudget();
+        if (budget and queuedBytes() > budget) {
+            if (!congested)
+                LOG4CPLUS_WARN(server->log,
+                        LOG4CPLUS_TEXT("Client congested, ")
+                        << queuedBytes()
+                        << LOG4CPLUS_TEXT(" bytes in output queue"));
+            congested = true;
+
+            switch (server->getBackpressure()) {
+                case Server::DropFrames:
+                    drop = true;
+                    break;
+
+                case Server::RaiseReduction:
+                    reduction = std::min(2 * reduction, size_t(1024));
+                    break;
+
+                case Server::Disconnect:
+                    LOG4CPLUS_ERROR_STR(server->log,
+                            LOG4CPLUS_TEXT(
+                                "Output budget exceeded; disconnecting"));
+                    return;
+            }
+        }
+        else if (congested and queuedBytes() < budget / 2) {
+            // Reduce in steps so that the client is not congested
+            // right away again
+            if (reduction > 1)
+                reduction /= 2;
+            else {
+                LOG4CPLUS_INFO_STR(server->log,
+                        LOG4CPLUS_TEXT("Client not congested any more"));
+                congested = false;
             }
         }
 
         for (SubscriptionManagerVector::iterator it = subscriptionManager.begin();
-                it != subscriptionManager.end(); ++it)
-            (*it)->rxPdo(quiet);
-
-        PdServ::EventData e;
-        do {
-            e = main->getNextEvent(this);
-        } while (Event::toXml(this, e));
+                it != subscriptionManager.end(); ++it) {
+            size_t skipped = (*it)->rxPdo(quiet or drop, reduction);
+            if (!quiet)
+                droppedFrames += skipped;
+        }
     }
 }
 
@@ -314,12 +527,13 @@ void Session::processCommand(const XmlParser* parser)
     const char *command = parser->tag();
     size_t commandLen = strlen(command);
 
-    static const struct {
+    struct Command {
         size_t len;
         const char *name;
         void (Session::*func)(const XmlParser*);
-    } cmds[] = {
-        // First list most common commands
+    };
+
+    static const Command cmds[] = {
         { 4, "ping",                    &Session::ping                  },
         { 2, "rs",                      &Session::readStatistics        },
         { 2, "wp",                      &Session::writeParameter        },
@@ -327,16 +541,20 @@ void Session::processCommand(const XmlParser* parser)
         { 4, "xsad",                    &Session::xsad                  },
         { 4, "xsod",                    &Session::xsod                  },
         { 4, "echo",                    &Session::echo                  },
-
-        // Now comes the rest
         { 2, "rc",                      &Session::readChannel           },
         { 2, "rk",                      &Session::readChannel           },
         { 3, "rpv",                     &Session::readParamValues       },
         { 4, "list",                    &Session::listDirectory         },
+        { 7, "capture",                 &Session::capture               },
+        { 7, "history",                 &Session::history               },
 #ifdef GNUTLS_FOUND
         { 8, "starttls",                &Session::startTLS              },
+#endif
+#ifdef ZLIB_FOUND
+        { 8, "compress",                &Session::compress              },
 #endif
         { 9, "broadcast",               &Session::broadcast             },
+        { 9, "catalogue",               &Session::readCatalogue         },
         {11, "remote_host",             &Session::remoteHost            },
         {12, "read_kanaele",            &Session::readChannel           },
         {12, "read_statics",            &Session::readStatistics        },
@@ -348,17 +566,48 @@ void Session::processCommand(const XmlParser* parser)
         {0,  0,                         0},
     };
 
-    // Go through the command list
-    for (size_t idx = 0; cmds[idx].len; idx++) {
+    // Hash table of indices into cmds with open addressing. It is built
+    // once and is sparse enough that a lookup hardly ever needs more than
+    // one comparison
+    struct CommandTable {
+        enum {Size = 64, Empty = 0xFF};
+
+        CommandTable() {
+            std::fill(slot, slot + Size, uint8_t(Empty));
+
+            for (size_t idx = 0; cmds[idx].len; idx++) {
+                size_t h = hash(cmds[idx].name, cmds[idx].len);
+                while (slot[h] != Empty)
+                    h = (h + 1) % Size;
+                slot[h] = idx;
+            }
+        }
+
+        // FNV-1a
+        static size_t hash(const char *s, size_t len) {
+            uint32_t h = 2166136261U;
+            while (len--)
+                h = (h ^ uint8_t(*s++)) * 16777619U;
+            return h % Size;
+        }
+
+        uint8_t slot[Size];
+    };
+    static const CommandTable table;
+
+    for (size_t h = CommandTable::hash(command, commandLen);
+            table.slot[h] != CommandTable::Empty;
+            h = (h + 1) % CommandTable::Size) {
+        const Command& cmd = cmds[table.slot[h]];
+
         // Check whether the lengths fit and the string matches
-        if (commandLen == cmds[idx].len
-                and !strcmp(cmds[idx].name, command)) {
+        if (commandLen == cmd.len and !strcmp(cmd.name, command)) {
 
             LOG4CPLUS_TRACE_STR(server->log,
-                    LOG4CPLUS_C_STR_TO_TSTRING(cmds[idx].name));
+                    LOG4CPLUS_C_STR_TO_TSTRING(cmd.name));
 
             // Call the method
-            (this->*cmds[idx].func)(parser);
+            (this->*cmd.func)(parser);
 
             // Finished
             return;
@@ -391,6 +640,171 @@ void Session::broadcast(const XmlParser* parser)
     server->broadcast(this, ts, action, text);
 }
 
+/////////////////////////////////////////////////////////////////////////////
+void Session::capture(const XmlParser* parser)
+{
+    unsigned int group, triggerIdx, pre, post, precision;
+    std::list<unsigned int> indexList;
+    const Server::Channels& channel = server->getChannels();
+
+    if (!parser->getUnsigned("group", group))
+        group = 0;
+
+    // A new capture replaces the one of the same group
+    for (SubscriptionManagerVector::iterator it = subscriptionManager.begin();
+            it != subscriptionManager.end(); ++it)
+        (*it)->removeCapture(group);
+
+    if (parser->isTrue("stop"))
+        return;
+
+    if (!parser->getUnsigned("trigger", triggerIdx)
+            or triggerIdx >= channel.size()
+            or !channel[triggerIdx]->dtype.isPrimary()
+            or !parser->getUnsignedList("channels", indexList)) {
+        XmlElement warn(createElement("warn"));
+        XmlElement::Attribute(warn, "command") << "capture";
+        XmlElement::Attribute(warn, "text")
+            << "primary trigger and channels are required";
+        return;
+    }
+
+    const Channel *trigger = channel[triggerIdx];
+    const PdServ::Task *task = trigger->signal->task;
+
+    // All channels have to be sampled by the trigger's task
+    std::vector<const Channel*> channels;
+    for (std::list<unsigned int>::const_iterator it = indexList.begin();
+            it != indexList.end(); it++) {
+        if (*it >= channel.size())
+            continue;
+
+        if (channel[*it]->signal->task != task) {
+            XmlElement warn(createElement("warn"));
+            XmlElement::Attribute(warn, "command") << "capture";
+            XmlElement::Attribute(warn, "text")
+                << "ignoring channel of a different task";
+            XmlElement::Attribute(warn, "index") << *it;
+            continue;
+        }
+
+        channels.push_back(channel[*it]);
+    }
+
+    Capture::Mode mode = Capture::Rising;
+    if (parser->isEqual("mode", "falling"))
+        mode = Capture::Falling;
+    else if (parser->isEqual("mode", "edge"))
+        mode = Capture::Edge;
+    else if (parser->isEqual("mode", "level"))
+        mode = Capture::Level;
+    else if (parser->isEqual("mode", "window"))
+        mode = Capture::Window;
+
+    double level = 0.0, upper = 0.0;
+    parser->getDouble("level", level);
+    parser->getDouble("upper", upper);
+
+    if (!parser->getUnsigned("pre", pre))
+        pre = 0;
+    if (!parser->getUnsigned("post", post) or !post)
+        post = 1;
+    if (!parser->getUnsigned("precision", precision))
+        precision = 16;
+
+    // Limit the memory of the ring
+    static const size_t maxRing = 64 * 1024 * 1024;
+    size_t sampleSize = Capture::sampleSize(channels);
+    if (channels.empty() or (size_t(pre) + post) * sampleSize > maxRing) {
+        XmlElement warn(createElement("warn"));
+        XmlElement::Attribute(warn, "command") << "capture";
+        XmlElement::Attribute(warn, "text")
+            << (channels.empty() ? "no channels" : "capture too large");
+        return;
+    }
+
+    subscriptionManager[task->index]->addCapture(group,
+            new Capture(trigger, channels, mode, level, upper, pre, post,
+                parser->isTrue("repeat"),
+                parser->isEqual("coding", "Base64"), precision));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Session::history(const XmlParser* parser)
+{
+    unsigned int reduction, precision;
+    double duration;
+    std::list<unsigned int> indexList;
+    const Server::Channels& channel = server->getChannels();
+    bool base64 = parser->isEqual("coding", "Base64");
+
+    if (!parser->getUnsignedList("channels", indexList))
+        return;
+
+    if (!parser->getUnsigned("reduction", reduction) or !reduction)
+        reduction = 1;
+
+    if (!parser->getUnsigned("precision", precision))
+        precision = 16;
+
+    // Without duration, everything available is sent
+    uint64_t since = 0;
+    if (parser->getDouble("duration", duration) and duration > 0.0) {
+        struct timespec ts;
+        main->gettime(&ts);
+
+        uint64_t now = 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+        uint64_t span = static_cast<uint64_t>(duration * 1.0e9);
+        since = now > span ? now - span : 0;
+    }
+
+    std::vector<uint64_t> time;
+    std::vector<char> value;
+
+    for (std::list<unsigned int>::const_iterator it = indexList.begin();
+            it != indexList.end(); it++) {
+        if (*it >= channel.size())
+            continue;
+
+        const Channel *c = channel[*it];
+        const HistoryRing *ring = server->getHistory(c);
+
+        if (!ring) {
+            XmlElement warn(createElement("warn"));
+            XmlElement::Attribute(warn, "command") << "history";
+            XmlElement::Attribute(warn, "text") << "no history for channel";
+            XmlElement::Attribute(warn, "index") << *it;
+            continue;
+        }
+
+        time.clear();
+        value.clear();
+        size_t n = ring->read(since, reduction, time, value);
+
+        XmlElement historyTag(createElement("history"));
+        XmlElement::Attribute(historyTag, "c") << c->index;
+        XmlElement::Attribute(historyTag, "count") << n;
+
+        if (!n)
+            continue;
+
+        {
+            XmlElement t(historyTag.createChild("time"));
+            XmlElement::Attribute(t, "d").base64(
+                    &time[0], n * sizeof(uint64_t));
+        }
+
+        XmlElement datum(historyTag.createChild("F"));
+        XmlElement::Attribute(datum, "c") << c->index;
+
+        XmlElement::Attribute d(datum, "d");
+        if (base64)
+            d.base64(&value[0], value.size());
+        else
+            d.csv(c, &value[0], n, precision);
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////
 void Session::echo(const XmlParser* parser)
 {
@@ -403,6 +817,22 @@ void Session::ping(const XmlParser* /*parser*/)
     createElement("ping");
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// <catalogue hash="..."/> only confirms the hash when the client already
+// has the current catalogue
+void Session::readCatalogue(const XmlParser* parser)
+{
+    const Catalogue& catalogue = server->getCatalogue();
+    XmlElement element(createElement("catalogue"));
+
+    if (parser->isEqual("hash", catalogue.hash().c_str())) {
+        XmlElement::Attribute(element, "hash") << catalogue.hash();
+        XmlElement::Attribute(element, "unchanged") << 1;
+    }
+    else
+        element.appendAttributes(catalogue.attributes());
+}
+
 /////////////////////////////////////////////////////////////////////////////
 void Session::readChannel(const XmlParser* parser)
 {
@@ -436,16 +866,8 @@ void Session::readChannel(const XmlParser* parser)
     }
 
     // A list of all channels
-    const Server::Channels& chanList = server->getChannels();
-    XmlElement channels(createElement("channels"));
-    for (Server::Channels::const_iterator it = chanList.begin();
-            it != chanList.end(); it++) {
-        if ((*it)->hidden)
-            continue;
-
-        XmlElement el(channels.createChild("channel"));
-        (*it)->setXmlAttributes( el, shortReply, 0, 16, 0);
-    }
+    job = new ChannelListJob(commandId, xmlstream.compact,
+            server->getChannels(), shortReply);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -456,8 +878,61 @@ void Session::listDirectory(const XmlParser* parser)
     if (!parser->find("path", &path))
         return;
 
-    XmlElement element(createElement("listing"));
-    server->listDir(this, element, path);
+    ListingJob::Options options;
+    unsigned int n;
+
+    if (parser->getUnsigned("depth", n))
+        options.depth = n;
+    if (parser->getUnsigned("count", n))
+        options.limit = n;
+    options.values = !parser->isTrue("novalues");
+    parser->getString("glob", options.glob);
+
+    // Continue a listing that was limited by count. A cursor that does
+    // not resolve must not restart the listing
+    const DirectoryNode *cursor = 0;
+    std::string cursorPath;
+    if (parser->find("cursor")) {
+        parser->getString("cursor", cursorPath);
+        cursor = server->find<DirectoryNode>(cursorPath);
+        if (!cursor) {
+            XmlElement warn(createElement("warn"));
+            XmlElement::Attribute(warn, "command") << "list";
+            XmlElement::Attribute(warn, "text") << "invalid cursor";
+            return;
+        }
+    }
+
+    std::string regex;
+    if (parser->getString("regex", regex)) {
+        options.regex = new regex_t;
+        int rv = ::regcomp(options.regex, regex.c_str(),
+                REG_EXTENDED | REG_NOSUB);
+        if (rv) {
+            char error[100];
+            ::regerror(rv, options.regex, error, sizeof(error));
+            delete options.regex;
+
+            XmlElement warn(createElement("warn"));
+            XmlElement::Attribute(warn, "command") << "list";
+            XmlElement::Attribute(warn, "text") << error;
+            return;
+        }
+    }
+
+    ListingJob *listing = new ListingJob(commandId, xmlstream.compact,
+            this, server->getDirectory(path), options, cursor);
+
+    if (cursor and !listing->valid()) {
+        delete listing;
+
+        XmlElement warn(createElement("warn"));
+        XmlElement::Attribute(warn, "command") << "list";
+        XmlElement::Attribute(warn, "text") << "invalid cursor";
+        return;
+    }
+
+    job = listing;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -481,6 +956,14 @@ void Session::readParameter(const XmlParser* parser)
     }
 
     if (p) {
+        // Optionally only a slice of elements
+        unsigned int startindex = 0, count = p->dim.nelem;
+        if (parser->getUnsigned("startindex", startindex)
+                and startindex >= p->dim.nelem)
+            return;
+        parser->getUnsigned("count", count);
+        count = std::min(count, unsigned(p->dim.nelem - startindex));
+
         char buf[p->mainParam->memSize];
         struct timespec ts;
 
@@ -489,63 +972,76 @@ void Session::readParameter(const XmlParser* parser)
         std::string id;
         parser->getString("id", id);
 
-        XmlElement xml(createElement("parameter"));
-        p->setXmlAttributes(xml, buf, ts, shortReply, hex, 16);
-
-        return;
-    }
+        // Raw data, optionally converted to another type and byte order
+        if (parser->isTrue("base64") and p->dtype.isPrimary()) {
+            const PdServ::DataType* wire = &p->dtype;
+            const char *s;
+            if (parser->find("typ", &s) and s
+                    and !(wire = ValueDecoder::findType(s)))
+                return;
 
-    XmlElement parametersElement(createElement("parameters"));
+            bool swap = parser->find("endian", &s) and s
+                and ValueDecoder::needsSwap(s);
 
-    const Server::Parameters& parameters = server->getParameters();
-    Server::Parameters::const_iterator it = parameters.begin();
-    while ( it != parameters.end()) {
-        const PdServ::Parameter* mainParam = (*it)->mainParam;
-        char buf[mainParam->memSize];
-        struct timespec ts;
+            XmlElement xml(createElement("parameter"));
+            p->setXmlAttributes(xml, 0, ts, shortReply, false, 16);
+            p->setBase64Value(xml, buf, startindex, count, *wire, swap);
 
-        if ((*it)->hidden) {
-            ++it;
-            continue;
+            return;
         }
 
-        mainParam->getValue(this, buf, &ts);
+        XmlElement xml(createElement("parameter"));
+        p->setXmlAttributes(xml, buf, ts, shortReply, hex, 16,
+                startindex, count);
 
-        while (it != parameters.end() and mainParam == (*it)->mainParam) {
-            XmlElement xml(parametersElement.createChild("parameter"));
-            (*it++)->setXmlAttributes(xml, buf, ts, shortReply, hex, 16);
-        }
+        return;
     }
+
+    // With since, only parameters changed after that parameter
+    // generation are reported. A generation from the future, e.g. from
+    // before a restart of the process, is treated like 0
+    unsigned int since;
+    if (!parser->getUnsigned("since", since)
+            or since > main->getParameterGeneration())
+        since = 0;
+
+    job = new ParameterListJob(commandId, xmlstream.compact,
+            this, server->getParameters(), shortReply, hex, since);
 }
 
 /////////////////////////////////////////////////////////////////////////////
 void Session::readParamValues(const XmlParser* /*parser*/)
 {
-    XmlElement param_values(createElement("param_values"));
-    XmlElement::Attribute values(param_values, "value");
+    job = new ParameterValuesJob(commandId, xmlstream.compact,
+            this, server->getParameters());
+}
 
-    const Server::Parameters& parameters = server->getParameters();
-    Server::Parameters::const_iterator it = parameters.begin();
-    while ( it != parameters.end()) {
-        const PdServ::Parameter* mainParam = (*it)->mainParam;
-        char buf[mainParam->memSize];
-        struct timespec ts;
+/////////////////////////////////////////////////////////////////////////////
+// Generate the next part of a job's reply, sending it when complete
+void Session::runJob()
+{
+    // Number of variables processed between data transmissions
+    static const size_t stepSize = 1000;
 
-        mainParam->getValue(this, buf, &ts);
+    if (!job->step(stepSize))
+        return;
 
-        if (it != parameters.begin())
-            values << ';';
-        values.csv(*it, buf, 1, 16);
+    std::string reply(job->str());
+    xmlstream.append(reply.data(), reply.size());
 
-        while (it != parameters.end() and mainParam == (*it)->mainParam)
-            ++it;
+    if (!job->id.empty()) {
+        XmlElement ack(createElement("ack"));
+        XmlElement::Attribute(ack,"id").setEscaped(job->id);
     }
+
+    delete job;
+    job = 0;
 }
 
 /////////////////////////////////////////////////////////////////////////////
 void Session::messageHistory(const XmlParser* /*parser*/)
 {
-    std::list<PdServ::EventData> list(main->getEventHistory(this));
+    std::list<PdServ::EventData> list(main->getEventHistory());
 
     while (!list.empty()) {
         Event::toXml(this, list.front());
@@ -577,6 +1073,16 @@ void Session::readStatistics(const XmlParser* /*parser*/)
             .setEscaped((*it).client.size() ? (*it).client : "unknown");
         XmlElement::Attribute(client,"countin") << (*it).countIn;
         XmlElement::Attribute(client,"countout") << (*it).countOut;
+        XmlElement::Attribute(client,"queued") << (*it).outputQueue;
+        XmlElement::Attribute(client,"maxqueued") << (*it).outputQueueMax;
+        XmlElement::Attribute(client,"dropped") << (*it).droppedFrames;
+        if ((*it).compressIn) {
+            XmlElement::Attribute(client,"compressin") << (*it).compressIn;
+            XmlElement::Attribute(client,"compressout")
+                << (*it).compressOut;
+            XmlElement::Attribute(client,"compresstime")
+                << (*it).compressTime;
+        }
         XmlElement::Attribute(client,"connectedtime") << (*it).connectedTime;
     }
 }
@@ -590,6 +1096,49 @@ void Session::startTLS(const XmlParser* /*parser*/)
     PdServ::Session::startTLS();
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// Compress the output stream:
+//      <compress algo="deflate" level="1"/>
+// The reply <compress> is the last uncompressed element. Everything
+// after it is a zlib stream (RFC 1950) that is flushed (Z_SYNC_FLUSH)
+// after every cycle of the session. The input stream is not compressed.
+// If compression is active already or cannot be started, <warn> is
+// sent instead of the reply.
+void Session::compress(const XmlParser* parser)
+{
+    std::string algo("deflate");
+    unsigned int level = 1;
+
+    parser->getString("algo", algo);
+    parser->getUnsigned("level", level);
+
+    if (algo != "deflate") {
+        XmlElement warn(createElement("warn"));
+        XmlElement::Attribute(warn, "text") << "unsupported algorithm";
+        XmlElement::Attribute(warn, "algo").setEscaped(algo);
+        return;
+    }
+
+    int result = PdServ::Session::startCompression(
+            std::max(1U, std::min(level, 9U)));
+    if (result) {
+        XmlElement warn(createElement("warn"));
+        XmlElement::Attribute(warn, "command") << "compress";
+        XmlElement::Attribute(warn, "text")
+            << (result == -EALREADY
+                    ? "compression is active" : "compression failed");
+        return;
+    }
+
+    {
+        XmlElement reply(createElement("compress"));
+        XmlElement::Attribute(reply, "algo") << algo;
+    }
+
+    // Compression starts after the reply
+    xmlstream.flush();
+}
+
 /////////////////////////////////////////////////////////////////////////////
 void Session::remoteHost(const XmlParser* parser)
 {
@@ -601,6 +1150,10 @@ void Session::remoteHost(const XmlParser* parser)
         writeAccess = parser->isEqual("access", "allow")
             or parser->isTrue("access");
 
+    // Compact output omits indentation and line ends
+    if (parser->find("compact"))
+        xmlstream.compact = parser->isTrue("compact");
+
     // Check whether stream should be polite, i.e. not send any data
     // when not requested by the client.
     // This is used for passive clients that do not check their streams
@@ -610,11 +1163,8 @@ void Session::remoteHost(const XmlParser* parser)
         polite = parser->isTrue("polite");
         if (polite) {
             changedParameter.clear();
+            changeLogPos = server->getChangeLog().head();
             aic.clear();
-            while (!broadcastList.empty()) {
-                delete broadcastList.front();
-                broadcastList.pop_front();
-            }
         }
     }
 
@@ -636,17 +1186,7 @@ void Session::writeParameter(const XmlParser* parser)
         return;
     }
 
-    const Parameter *p = 0;
-
-    unsigned int index;
-    std::string name;
-    if (parser->getString("name", name)) {
-        p = server->find<Parameter>(name);
-    }
-    else if (parser->getUnsigned("index", index)) {
-        p = server->getParameter(index);
-    }
-
+    const Parameter *p = findParameter(parser);
     if (!p)
         return;
 
@@ -661,7 +1201,24 @@ void Session::writeParameter(const XmlParser* parser)
 
     int errnum;
     const char *s;
-    if (parser->find("hexvalue", &s)) {
+    if (p != decodedParameter and parser->find("base64value", &s) and s
+            and setupDecoder(parser, p, "base64value")) {
+        // Value was not decoded while it was received, e.g. because
+        // typ came after it
+        valueDecoder.write(s, strlen(s));
+    }
+
+    if (p == decodedParameter) {
+        // The value was decoded while it was received
+        errnum = valueDecoder.finish()
+            ? p->setRawValue(this, valueDecoder.data(),
+                    valueDecoder.size(), startindex)
+            : -EINVAL;
+    }
+    else if (parser->find("base64value")) {
+        errnum = -EINVAL;
+    }
+    else if (parser->find("hexvalue", &s)) {
         errnum = p->setHexValue(this, s, startindex);
     }
     else if (parser->find("value", &s)) {
@@ -672,19 +1229,105 @@ void Session::writeParameter(const XmlParser* parser)
 
     if (errnum) {
         // If an error occurred, tell this client to reread the value
-        parameterChanged(p);
+        parameterChanged(p, 0, p->memSize);
     }
 }
 
+/////////////////////////////////////////////////////////////////////////////
+const Parameter* Session::findParameter(const XmlParser* parser) const
+{
+    unsigned int index;
+    std::string name;
+
+    if (parser->getString("name", name))
+        return server->find<Parameter>(name);
+    else if (parser->getUnsigned("index", index))
+        return server->getParameter(index);
+
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// A value decoded before belongs to an element that was processed or
+// dropped, e.g. because it was malformed
+void Session::startElement()
+{
+    decodedParameter = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Decode the value of <wp> while it is received, so that large values
+// need not be kept in the parser's buffer. This works when the
+// parameter is known before the value starts, i.e. name or index come
+// first. Otherwise the value is buffered and parsed as a whole
+bool Session::openValue(const XmlParser* parser, const char* attribute)
+{
+    const char *tag = parser->tag();
+    if (!writeAccess
+            or (strcmp(tag, "wp") and strcmp(tag, "write_parameter")))
+        return false;
+
+    // Check the attribute before looking at the others: this is called
+    // for every quoted attribute, e.g. for name while it is still
+    // incomplete
+    if (strcasecmp(attribute, "value") and strcasecmp(attribute, "hexvalue")
+            and strcasecmp(attribute, "base64value"))
+        return false;
+
+    const Parameter *p = findParameter(parser);
+    return p and setupDecoder(parser, p, attribute);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Prepare valueDecoder for the value in attribute. base64value may be
+// qualified with the element type (typ) and byte order (endian) of the
+// raw data; they default to the parameter's type in native byte order.
+bool Session::setupDecoder(const XmlParser* parser, const Parameter* p,
+        const char* attribute)
+{
+    ValueDecoder::Coding coding;
+    if (!strcasecmp(attribute, "value"))
+        coding = ValueDecoder::Csv;
+    else if (!strcasecmp(attribute, "hexvalue"))
+        coding = ValueDecoder::Hex;
+    else if (!strcasecmp(attribute, "base64value"))
+        coding = ValueDecoder::Base64;
+    else
+        return false;
+
+    if (!p->dtype.isPrimary())
+        return false;
+
+    const PdServ::DataType* wire = &p->dtype;
+    const char *s;
+    if (parser->find("typ", &s) and s
+            and !(wire = ValueDecoder::findType(s)))
+        return false;
+
+    bool swap = parser->find("endian", &s) and s
+        and ValueDecoder::needsSwap(s);
+
+    valueDecoder.reset(p->dtype, p->dim.nelem, coding, wire, swap);
+    decodedParameter = p;
+
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Session::writeValue(const char* s, size_t n)
+{
+    valueDecoder.write(s, n);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 void Session::xsad(const XmlParser* parser)
 {
     unsigned int reduction, blocksize, precision, group;
     bool base64 = parser->isEqual("coding", "Base64");
     bool event = parser->isTrue("event");
+    bool aggregate = !event and parser->isTrue("aggregate");
     bool foundReduction = false;
-    std::list<unsigned int> indexList;
-    const Server::Channels& channel = server->getChannels();
+    std::vector<const Channel*> selection;
 
     if (parser->isTrue("sync")) {
         for (SubscriptionManagerVector::iterator it = subscriptionManager.begin();
@@ -698,7 +1341,7 @@ void Session::xsad(const XmlParser* parser)
         quiet = parser->isTrue("quiet");
     }
 
-    if (!parser->getUnsignedList("channels", indexList))
+    if (!selectChannels(parser, selection))
         return;
 
     if (parser->getUnsigned("reduction", reduction)) {
@@ -740,14 +1383,40 @@ void Session::xsad(const XmlParser* parser)
     if (!parser->getUnsigned("group", group))
         group = 0;
 
-    for (std::list<unsigned int>::const_iterator it = indexList.begin();
-            it != indexList.end(); it++) {
-        if (*it >= channel.size())
-            continue;
+    // Event filter options. Intervals are given in seconds
+    double deadband = 0.0, relDeadband = 0.0;
+    double minInterval = 0.0, maxInterval = 0.0;
+    if (event) {
+        parser->getDouble("deadband", deadband);
+        parser->getDouble("reldeadband", relDeadband);
+        parser->getDouble("mininterval", minInterval);
+        parser->getDouble("maxinterval", maxInterval);
+    }
 
-        const Channel *c = channel[*it];
+    // Slice of every channel's elements
+    unsigned int start = 0, count = 0, stride = 1;
+    parser->getUnsigned("start", start);
+    parser->getUnsigned("count", count);
+    if (parser->getUnsigned("stride", stride) and !stride) {
+        XmlElement warn(createElement("warn"));
+        XmlElement::Attribute(warn, "command") << "xsad";
+        XmlElement::Attribute(warn, "text")
+            << "specified stride=0, choosing stride=1";
+
+        stride = 1;
+    }
+
+    size_t outOfRange = 0;
+    for (std::vector<const Channel*>::const_iterator it = selection.begin();
+            it != selection.end(); it++) {
+        const Channel *c = *it;
         const PdServ::Signal *mainSignal = c->signal;
 
+        if (start >= c->memSize / c->dtype.size) {
+            ++outOfRange;
+            continue;
+        }
+
         if (event) {
             if (!foundReduction)
                 // If user did not supply a reduction, limit to a
@@ -761,32 +1430,61 @@ void Session::xsad(const XmlParser* parser)
                     1.0/mainSignal->sampleTime() / blocksize + 0.5);
         }
 
+        SubscriptionOptions options;
+        options.aggregate = aggregate;
+        options.start = start;
+        options.count = count;
+        options.stride = stride;
+        if (event) {
+            double ts = mainSignal->sampleTime();
+
+            options.deadband = deadband;
+            options.relDeadband = relDeadband;
+            if (minInterval > 0.0)
+                options.minInterval =
+                    std::max(1.0, minInterval / ts + 0.5);
+            if (maxInterval > 0.0)
+                options.maxInterval =
+                    std::max(1.0, maxInterval / ts + 0.5);
+        }
+
         subscriptionManager[c->signal->task->index]->subscribe(
-                c, group, reduction, blocksize, base64, precision);
+                c, group, reduction, blocksize, base64, precision, options);
+    }
+
+    if (outOfRange) {
+        XmlElement warn(createElement("warn"));
+        XmlElement::Attribute(warn, "command") << "xsad";
+        XmlElement::Attribute(warn, "text")
+            << "start is beyond the end of " << outOfRange << " channels";
     }
+
+    for (SubscriptionManagerVector::iterator it = subscriptionManager.begin();
+            it != subscriptionManager.end(); ++it)
+        (*it)->commit();
 }
 
 /////////////////////////////////////////////////////////////////////////////
 void Session::xsod(const XmlParser* parser)
 {
-    std::list<unsigned int> intList;
+    std::vector<const Channel*> selection;
 
-    //cout << __LINE__ << "xsod: " << endl;
-
-    if (parser->getUnsignedList("channels", intList)) {
-        const Server::Channels& channel = server->getChannels();
+    if (selectChannels(parser, selection)) {
         unsigned int group;
 
         if (!parser->getUnsigned("group", group))
             group = 0;
 
-        for (std::list<unsigned int>::const_iterator it = intList.begin();
-                it != intList.end(); it++) {
-            if (*it < channel.size()) {
-                size_t taskIdx = channel[*it]->signal->task->index;
-                subscriptionManager[taskIdx]->unsubscribe(channel[*it], group);
-            }
+        for (std::vector<const Channel*>::const_iterator it =
+                selection.begin(); it != selection.end(); it++) {
+            size_t taskIdx = (*it)->signal->task->index;
+            subscriptionManager[taskIdx]->unsubscribe(*it, group);
         }
+
+        for (SubscriptionManagerVector::iterator it =
+                subscriptionManager.begin();
+                it != subscriptionManager.end(); ++it)
+            (*it)->commit();
     }
     else
         for (SubscriptionManagerVector::iterator it = subscriptionManager.begin();
@@ -794,6 +1492,73 @@ void Session::xsod(const XmlParser* parser)
             (*it)->clear();
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// The channels of <xsad> and <xsod> are given either as indices or as
+// a path. The latter selects the channel at path or all channels below,
+// optionally only those whose path matches glob.
+bool Session::selectChannels(const XmlParser* parser,
+        std::vector<const Channel*>& selection) const
+{
+    std::list<unsigned int> indexList;
+
+    if (parser->getUnsignedList("channels", indexList)) {
+        const Server::Channels& channel = server->getChannels();
+
+        for (std::list<unsigned int>::const_iterator it = indexList.begin();
+                it != indexList.end(); it++) {
+            if (*it < channel.size())
+                selection.push_back(channel[*it]);
+        }
+
+        return true;
+    }
+
+    std::string path, glob;
+    bool hasPath = parser->getString("path", path);
+    if (!parser->getString("glob", glob) and !hasPath)
+        return false;
+
+    const DirectoryNode *node = server->getDirectory(hasPath ? path : "/");
+    if (!node)
+        return true;
+
+    const Channel *c = dynamic_cast<const Channel *>(node);
+    if (c) {
+        if (glob.empty() or !::fnmatch(glob.c_str(), c->path().c_str(), 0))
+            selection.push_back(c);
+        return true;
+    }
+
+    // The elements of a vector channel follow it in the walk. They are
+    // skipped when the channel itself is selected
+    const Channel *covering = 0;
+    std::string coveredPath;
+
+    DirectoryNode::Walker walker(node, 0);
+    while ((node = walker.next())) {
+        c = dynamic_cast<const Channel *>(node);
+        if (!c or c->hidden)
+            continue;
+
+        const std::string& nodePath = walker.path();
+        if (covering and c->signal == covering->signal
+                and !nodePath.compare(0, coveredPath.size(), coveredPath))
+            continue;
+
+        if (!glob.empty() and ::fnmatch(glob.c_str(), nodePath.c_str(), 0))
+            continue;
+
+        // Elements returned by the walk are not kept
+        c = server->getChannel(c->index);
+        selection.push_back(c);
+
+        covering = c;
+        coveredPath = nodePath + '/';
+    }
+
+    return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 XmlElement Session::createElement(const char* name)
 {
@@ -823,6 +1588,8 @@ ssize_t Session::read(void* buf, size_t count)
     ssize_t result = readData(buf, count);
     if (result < 0)
         result = getErrorNumber() == errInput ? -errno : -EAGAIN;
+    else
+        inBytes += result;
 
 //    log_debug("result = %zi", result);
     return result;
@@ -832,9 +1599,29 @@ ssize_t Session::read(void* buf, size_t count)
 ssize_t Session::write(const void* buf, size_t count)
 {
 //    log_debug("%zu", count);
-    ssize_t result = writeData(buf, count);
+    ssize_t result = ::send(so, buf, count, MSG_DONTWAIT | MSG_NOSIGNAL);
     if (result < 0)
         result = -errno;
+    else
+        outBytes += result;
 //    log_debug("result = %zi", result);
     return result;
 }
+
+/////////////////////////////////////////////////////////////////////////////
+ssize_t Session::writev(const struct iovec* iov, int iovcnt)
+{
+    struct msghdr msg;
+
+    ::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<struct iovec*>(iov);
+    msg.msg_iovlen = iovcnt;
+
+    ssize_t result = ::sendmsg(so, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (result < 0)
+        result = -errno;
+    else
+        outBytes += result;
+
+    return result;
+}
@@ -35,7 +35,7 @@
 //Liste der Features der aktuellen rtlib-Version, wichtig, muß aktuell gehalten werden
 //da der Testmanager sich auf die Features verläßt
 
-#define MSR_FEATURES "pushparameters,binparameters,eventchannels,statistics,pmtime,aic,messages,polite,list"
+#define MSR_FEATURES "pushparameters,binparameters,eventchannels,statistics,pmtime,aic,messages,polite,list,compact,aggregate,capture,history,generation,range,base64,listfilter,catalogue,pathsubscribe,slice"
 
 /* pushparameters: Parameter werden vom Echtzeitprozess an den Userprozess gesendet bei Änderung
    binparameters: Parameter können Binär übertragen werden
@@ -51,11 +51,13 @@
 #include "../Session.h"
 #include "XmlParser.h"
 #include "XmlElement.h"
+#include "ValueDecoder.h"
 
 #include <cc++/thread.h>
 #include <cc++/socketport.h>
 #include <vector>
 #include <set>
+#include <map>
 #include <cstdio>
 
 struct timespec;
@@ -72,17 +74,21 @@ namespace MsrProto {
 class SubscriptionManager;
 class Server;
 class Parameter;
+class Channel;
+class Job;
 
 class Session:
     public ost::TCPSession,
-    public PdServ::Session {
+    public PdServ::Session,
+    private XmlParser::ValueStream {
     public:
         Session( Server *s, ost::TCPSocket *socket);
         ~Session();
 
-        void broadcast(Session *s, const struct timespec& ts,
-                const std::string &action, const std::string &element);
-        void parameterChanged(const Parameter*);
+        // Interrupt waiting for input, e.g. when there are new messages
+        void wakeup();
+        // Byte range [begin, end) relative to the parameter
+        void parameterChanged(const Parameter*, size_t begin, size_t end);
         void setAIC(const Parameter* p);
         void getSessionStatistics(PdServ::SessionStatistics &stats) const;
         XmlElement createElement(const char *name);
@@ -100,18 +106,34 @@ class Session:
 
         size_t inBytes;
         size_t outBytes;
+
+        // Backpressure management
+        bool congested;
+        size_t reduction;
+        size_t droppedFrames;
         std::string peer() const;
 
-        std::ostream xmlstream;
+        XmlStream xmlstream;
 
         std::string commandId;
 
+        // Reply to a command that is generated in steps. No further
+        // commands are processed until it is finished
+        Job *job;
+        void runJob();
+
         // Protection for inter-session communication
         ost::Mutex mutex;
 
-        // List of parameters that have changed
-        typedef std::set<const Parameter*> ParameterSet;
-        ParameterSet changedParameter;
+        // Parameters that have changed with the range of elements
+        // [first, second), collected from the server's change log.
+        // Only used by the session thread
+        typedef std::pair<size_t, size_t> ElementRange;
+        typedef std::map<const Parameter*, ElementRange> ParameterMap;
+        ParameterMap changedParameter;
+        unsigned int changeLogPos;
+        unsigned int changeGeneration;  // Of the last entry read
+        void readChangeLog();
 
         // Asynchronous input channels.
         // These are actually parameters that are misused as input streams.
@@ -121,14 +143,14 @@ class Session:
         MainParameterSet aic;
         size_t aicDelay;        // When 0, notify that aic's have changed
 
-        // Broadcast list.
-        typedef struct {
-            struct timespec ts;
-            std::string action;
-            std::string message;
-        } Broadcast;
-        typedef std::list<const Broadcast*> BroadcastList;
-        BroadcastList broadcastList;
+        // Position in the server's broadcast and event messages
+        unsigned int messagePos;
+        void readMessages();
+
+        // Pipe to interrupt waiting for input
+        int wakePipe[2];
+        volatile int woken;
+        bool waitInput(int timeout);
 
         typedef std::vector<SubscriptionManager*> SubscriptionManagerVector;
         SubscriptionManagerVector subscriptionManager;
@@ -147,9 +169,22 @@ class Session:
 
         // Reimplemented from PdServ::Session
         ssize_t write(const void* buf, size_t len);
+        ssize_t writev(const struct iovec* iov, int iovcnt);
         ssize_t read(       void* buf, size_t len);
 
         void processCommand(const XmlParser*);
+        const Parameter* findParameter(const XmlParser*) const;
+
+        // Values of <wp> are decoded while they are received
+        ValueDecoder valueDecoder;
+        const Parameter* decodedParameter;
+
+        // Reimplemented from XmlParser::ValueStream
+        void startElement();
+        bool openValue(const XmlParser* parser, const char* attribute);
+        void writeValue(const char* s, size_t n);
+        bool setupDecoder(const XmlParser* parser, const Parameter* p,
+                const char* attribute);
         // Management variables
         bool writeAccess;
         bool quiet;
@@ -160,8 +195,11 @@ class Session:
 
         // Here are all the commands the MSR protocol supports
         void broadcast(const XmlParser*);
+        void capture(const XmlParser*);
+        void history(const XmlParser*);
         void echo(const XmlParser*);
         void ping(const XmlParser*);
+        void readCatalogue(const XmlParser*);
         void readChannel(const XmlParser*);
         void listDirectory(const XmlParser*);
         void readParameter(const XmlParser*);
@@ -170,9 +208,13 @@ class Session:
         void messageHistory(const XmlParser*);
         void remoteHost(const XmlParser*);
         void startTLS(const XmlParser*);
+        void compress(const XmlParser*);
         void writeParameter(const XmlParser*);
         void xsad(const XmlParser*);
         void xsod(const XmlParser*);
+
+        bool selectChannels(const XmlParser*,
+                std::vector<const Channel*>& selection) const;
 };
 
 }
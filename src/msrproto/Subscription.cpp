@@ -30,25 +30,164 @@
 #include "../DataType.h"
 
 #include <algorithm>
+#include <cmath>
 
 using namespace MsrProto;
 
+/////////////////////////////////////////////////////////////////////////////
+// Element wise operations in the native type of a channel. The loops have
+// no early exit so that the compiler can vectorize them.
+template <typename T>
+struct Native {
+    // Check whether any element of value differs from ref by more than
+    // the deadband
+    static bool exceeds(const char *value, const char *ref, size_t n,
+            double deadband, double relDeadband) {
+        const T *v = reinterpret_cast<const T*>(value);
+        const T *r = reinterpret_cast<const T*>(ref);
+        bool result = false;
+
+        for (size_t i = 0; i < n; ++i) {
+            double diff = std::fabs(double(v[i]) - double(r[i]));
+            double limit =
+                std::max(deadband, relDeadband * std::fabs(double(r[i])));
+            result |= diff > limit;
+        }
+
+        return result;
+    }
+
+    // Update min, max, sum and sum of squares
+    static void accumulate(const char *value, double *acc,
+            size_t n, bool first) {
+        const T *v = reinterpret_cast<const T*>(value);
+        double *min = acc, *max = acc + n, *sum = acc + 2*n, *sq = acc + 3*n;
+
+        if (first) {
+            for (size_t i = 0; i < n; ++i) {
+                double x = v[i];
+                min[i] = max[i] = sum[i] = x;
+                sq[i] = x * x;
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            double x = v[i];
+            min[i] = std::min(min[i], x);
+            max[i] = std::max(max[i], x);
+            sum[i] += x;
+            sq[i] += x * x;
+        }
+    }
+};
+
 /////////////////////////////////////////////////////////////////////////////
 Subscription::Subscription(const Channel *channel,
-        size_t decimation, size_t blocksize, bool base64, std::streamsize precision):
+        size_t decimation, size_t blocksize, bool base64, std::streamsize precision,
+        const SubscriptionOptions& options):
     channel(channel),
     decimation(blocksize ? decimation : 1),
     blocksize(blocksize),
-    bufferOffset(channel->offset),
-    trigger_start(decimation)
+    bufferOffset(channel->offset + options.start * channel->dtype.size),
+    start(options.start),
+    stride(std::max(options.stride, size_t(1))),
+    trigger_start(options.minInterval ? options.minInterval : decimation),
+    heartbeat(options.maxInterval),
+    deadband(options.deadband),
+    relDeadband(options.relDeadband)
 {
     trigger = 0;
+    idle = 0;
     nblocks = 0;
+    reported = false;
+
+    // Deadbands and aggregates are evaluated in the native type of
+    // the channel
+    bool (*exceeds)(const char *, const char *, size_t, double, double) = 0;
+    accumulateFunc = 0;
+    switch (channel->dtype.primary()) {
+        case PdServ::DataType::boolean_T:
+            // Booleans are compared bitwise
+            accumulateFunc = Native<uint8_t>::accumulate;
+            break;
+        case PdServ::DataType::uint8_T:
+            exceeds = Native<uint8_t>::exceeds;
+            accumulateFunc = Native<uint8_t>::accumulate;
+            break;
+        case PdServ::DataType::int8_T:
+            exceeds = Native<int8_t>::exceeds;
+            accumulateFunc = Native<int8_t>::accumulate;
+            break;
+        case PdServ::DataType::uint16_T:
+            exceeds = Native<uint16_t>::exceeds;
+            accumulateFunc = Native<uint16_t>::accumulate;
+            break;
+        case PdServ::DataType::int16_T:
+            exceeds = Native<int16_t>::exceeds;
+            accumulateFunc = Native<int16_t>::accumulate;
+            break;
+        case PdServ::DataType::uint32_T:
+            exceeds = Native<uint32_t>::exceeds;
+            accumulateFunc = Native<uint32_t>::accumulate;
+            break;
+        case PdServ::DataType::int32_T:
+            exceeds = Native<int32_t>::exceeds;
+            accumulateFunc = Native<int32_t>::accumulate;
+            break;
+        case PdServ::DataType::uint64_T:
+            exceeds = Native<uint64_t>::exceeds;
+            accumulateFunc = Native<uint64_t>::accumulate;
+            break;
+        case PdServ::DataType::int64_T:
+            exceeds = Native<int64_t>::exceeds;
+            accumulateFunc = Native<int64_t>::accumulate;
+            break;
+        case PdServ::DataType::double_T:
+            exceeds = Native<double>::exceeds;
+            accumulateFunc = Native<double>::accumulate;
+            break;
+        case PdServ::DataType::single_T:
+            exceeds = Native<float>::exceeds;
+            accumulateFunc = Native<float>::accumulate;
+            break;
+        default:
+            // Compound types are compared bitwise and cannot be
+            // aggregated
+            break;
+    }
+
+    // Elements from start to the end of the channel
+    size_t total = channel->memSize / channel->dtype.size;
+    nelem = start < total ? (total - start + stride - 1) / stride : 0;
+    if (options.count)
+        nelem = std::min(nelem, options.count);
+    memSize = nelem * channel->dtype.size;
+    sliced = nelem < total;
+
+    slice = 0;
+    if (stride > 1 and nelem > 1)
+        slice = new char[memSize];
+
+    deadbandExceeded = 0;
+    if (!blocksize and (deadband > 0.0 or relDeadband > 0.0))
+        deadbandExceeded = exceeds;
+
+    acc = 0;
+    accCount = 0;
+    aggData = 0;
+    aggStride = blocksize * memSize;
+    if (!blocksize or !options.aggregate)
+        accumulateFunc = 0;
+    else if (accumulateFunc) {
+        acc = new double[4 * nelem];
+        aggData = new char[4 * aggStride];
+    }
 
     this->precision = precision;
     this->base64 = base64;
 
-    size_t dataLen = (blocksize + !blocksize) * channel->memSize;
+    size_t dataLen = (blocksize + !blocksize) * memSize;
 
     data_bptr = new char[dataLen];
     data_eptr = data_bptr + dataLen;
@@ -62,19 +201,69 @@ Subscription::Subscription(const Channel *channel,
 Subscription::~Subscription()
 {
     delete[] data_bptr;
+    delete[] acc;
+    delete[] aggData;
+    delete[] slice;
 }
 
 /////////////////////////////////////////////////////////////////////////////
-bool Subscription::newValue (const char *buf)
+// Returns the slice of the channel in buf
+const char *Subscription::select(const char *buf)
 {
-    const size_t n = channel->memSize;
     buf += bufferOffset;
+    if (!slice)
+        return buf;
+
+    const size_t size = channel->dtype.size;
+    char *dst = slice;
+    for (size_t i = 0; i < nelem; ++i, buf += stride * size, dst += size)
+        std::copy(buf, buf + size, dst);
+
+    return slice;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool Subscription::newValue (const char *buf)
+{
+    const size_t n = memSize;
+    buf = select(buf);
 
     if (!blocksize) {
-        if ((trigger and --trigger) or std::equal(buf, buf + n, data_bptr))
+        ++idle;
+
+        if (trigger and --trigger)
+            return false;
+
+        if (!(heartbeat and idle >= heartbeat) and !changed(buf))
             return false;
 
         trigger = trigger_start;
+        idle = 0;
+        reported = true;
+    }
+
+    if (accumulateFunc) {
+        // Should never happen, since accumulate() is called first
+        if (!accCount) {
+            accumulateFunc(buf, acc, nelem, true);
+            accCount = 1;
+        }
+
+        // Store min, max, mean and rms of the window in the current block
+        const double *min = acc, *max = acc + nelem;
+        const double *sum = acc + 2*nelem, *sq = acc + 3*nelem;
+        char *dst[4];
+        for (size_t k = 0; k < 4; ++k)
+            dst[k] = aggData + k*aggStride + nblocks*n;
+
+        for (size_t i = 0; i < nelem; ++i) {
+            channel->dtype.setValue(dst[0], min[i]);
+            channel->dtype.setValue(dst[1], max[i]);
+            channel->dtype.setValue(dst[2], sum[i] / accCount);
+            channel->dtype.setValue(dst[3], std::sqrt(sq[i] / accCount));
+        }
+
+        accCount = 0;
     }
 
     std::copy(buf, buf + n, data_pptr);
@@ -84,6 +273,27 @@ bool Subscription::newValue (const char *buf)
     return true;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+void Subscription::accumulate(const char *buf)
+{
+    accumulateFunc(select(buf), acc, nelem, !accCount);
+    ++accCount;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Compare buf with the last value reported
+bool Subscription::changed(const char *buf) const
+{
+    // The first value is always reported
+    if (!reported)
+        return true;
+
+    if (deadbandExceeded)
+        return deadbandExceeded(buf, data_bptr, nelem, deadband, relDeadband);
+
+    return !std::equal(buf, buf + memSize, data_bptr);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 void Subscription::print(XmlElement &parent)
 {
@@ -91,11 +301,33 @@ void Subscription::print(XmlElement &parent)
         XmlElement datum(parent.createChild(blocksize ? "F" : "E"));
         XmlElement::Attribute(datum, "c") << channel->index;
 
-        XmlElement::Attribute value(datum, "d");
-        if (base64)
-            value.base64(data_bptr, nblocks * channel->memSize);
-        else
-            value.csv(channel, data_bptr, nblocks, precision);
+        // Tell the client which elements the data covers
+        if (sliced) {
+            XmlElement::Attribute(datum, "start") << start;
+            XmlElement::Attribute(datum, "count") << nelem;
+            if (stride > 1)
+                XmlElement::Attribute(datum, "stride") << stride;
+        }
+
+        {
+            XmlElement::Attribute value(datum, "d");
+            if (base64)
+                value.base64(data_bptr, nblocks * memSize);
+            else
+                value.csv(channel->dtype, data_bptr, nblocks * nelem,
+                        precision);
+        }
+
+        static const char *aggName[4] = {"min", "max", "mean", "rms"};
+        for (size_t k = 0; aggData and k < 4; ++k) {
+            const char *data = aggData + k*aggStride;
+
+            XmlElement::Attribute value(datum, aggName[k]);
+            if (base64)
+                value.base64(data, nblocks * memSize);
+            else
+                value.csv(channel->dtype, data, nblocks * nelem, precision);
+        }
     }
 
     data_pptr = data_bptr;
@@ -107,4 +339,5 @@ void Subscription::reset()
 {
     data_pptr = data_bptr;
     nblocks = 0;
+    accCount = 0;
 }
@@ -28,10 +28,40 @@
 
 namespace MsrProto {
 
+class Channel;
+class XmlElement;
+
+// Optional subscription features. Intervals are in task cycles.
+struct SubscriptionOptions {
+    SubscriptionOptions(): deadband(0.0), relDeadband(0.0),
+        minInterval(0), maxInterval(0), aggregate(false),
+        start(0), count(0), stride(1) {}
+
+    // Filter options for event subscriptions (blocksize == 0)
+    double deadband;            // Report changes larger than this
+    double relDeadband;         // ... or larger than this fraction of the
+                                // last reported value
+    size_t minInterval;         // Minimum cycles between events;
+                                // 0: use decimation
+    size_t maxInterval;         // Report at least every maxInterval
+                                // cycles; 0: never
+
+    // Stream subscriptions only: report min/max/mean/rms over all
+    // samples of the decimation window in addition to the last value
+    bool aggregate;
+
+    // Report only count elements of the channel, starting at element
+    // start and stride elements apart; count = 0: up to the end
+    size_t start;
+    size_t count;
+    size_t stride;
+};
+
 class Subscription {
     public:
         Subscription(const Channel *, size_t decimation,
-                size_t blocksize, bool base64, std::streamsize precision);
+                size_t blocksize, bool base64, std::streamsize precision,
+                const SubscriptionOptions& options = SubscriptionOptions());
         ~Subscription();
 
         const Channel *channel;
@@ -42,16 +72,55 @@ class Subscription {
         void print(XmlElement &parent);
         void reset();
 
-        // Used when chaining Subscriptions together for printing
-        Subscription* next;
+        // Aggregating subscriptions see every sample using accumulate(),
+        // not only those selected by decimation
+        bool aggregating() const {
+            return accumulateFunc;
+        }
+        void accumulate(const char *buf);
 
     private:
+        // The reported slice: nelem elements from bufferOffset on,
+        // stride elements apart. memSize is the size of the slice
         const size_t bufferOffset;
+        const size_t start;
+        const size_t stride;
+        size_t memSize;
+        bool sliced;            // Not the whole channel
+
+        // Slices with stride > 1 are gathered here
+        char *slice;
+        const char *select(const char *buf);
 
         // Trigger delay mechanism for event channels
         const size_t trigger_start;
         size_t trigger;
 
+        // Heartbeat for event channels
+        const size_t heartbeat;
+        size_t idle;
+
+        // Deadband for event channels. deadbandExceeded is null when
+        // values are compared bitwise
+        const double deadband;
+        const double relDeadband;
+        bool (*deadbandExceeded)(const char *value, const char *ref,
+                size_t n, double deadband, double relDeadband);
+        size_t nelem;
+        bool reported;          // A value was reported already
+
+        bool changed(const char *buf) const;
+
+        // Aggregation over the decimation window. acc holds nelem
+        // min, max, sum and sum of squares each; aggData holds min,
+        // max, mean and rms of every block in the native type.
+        void (*accumulateFunc)(const char *value, double *acc,
+                size_t n, bool first);
+        double *acc;
+        size_t accCount;
+        char *aggData;
+        size_t aggStride;
+
         size_t nblocks;         // number of blocks to print
 
         std::streamsize precision;
@@ -30,6 +30,7 @@
 #include "Channel.h"
 #include "Session.h"
 #include "Subscription.h"
+#include "Capture.h"
 
 using namespace MsrProto;
 
@@ -44,6 +45,8 @@ SubscriptionManager::SubscriptionManager(
 {
     taskTime = &dummyTime;
     taskStatistics = &dummyTaskStatistics;
+    frameCount = 0;
+    dirty = false;
 
     // Call rxPdo() once so that taskTime and taskStatistics are updated
     task->rxPdo(this, &taskTime, &taskStatistics);
@@ -53,25 +56,29 @@ SubscriptionManager::SubscriptionManager(
 SubscriptionManager::~SubscriptionManager()
 {
     clear();
+
+    while (!captures.empty())
+        removeCapture(captures.begin()->first);
 }
 
 /////////////////////////////////////////////////////////////////////////////
 void SubscriptionManager::subscribe (const Channel *c, size_t group,
         size_t decimation, size_t blocksize, bool base64,
-        std::streamsize precision)
+        std::streamsize precision, const SubscriptionOptions& options)
 {
     Subscription** s = &signalSubscriptionMap[c->signal][c][group];
 
     // First remove possible subscription. It doesn't matter if it is null
     if (*s)
-        remove(*s, group);
+        remove(*s);
 
-    *s = new Subscription(c, decimation, blocksize, base64, precision);
+    *s = new Subscription(c, decimation, blocksize, base64, precision,
+            options);
 
-    // Call subscribe on this signal. It doesn't matter if it is already
-    // subscribed, but it is useful because newSignal() is called for us
-    // in this special case
-    c->signal->subscribe(this);
+    // The signal is subscribed by commit(). It doesn't matter if it is
+    // already subscribed, but it is useful because newSignal() is called
+    // for us in this special case
+    pendingSignals.insert(c->signal);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -93,7 +100,7 @@ void SubscriptionManager::unsubscribe(const Channel *c, size_t group)
         return;
 
     // Remove channel from active list
-    remove(git->second, group);
+    remove(git->second);
 
     // Now that the channel is unsubscribed, check for empty groups,
     // jumping out if the group is not empty
@@ -106,9 +113,13 @@ void SubscriptionManager::unsubscribe(const Channel *c, size_t group)
     if (!sit->second.empty())
         return;
 
-    // Don't require signal any more
+    // Don't require signal any more, unless a capture still uses it
     signalSubscriptionMap.erase(sit);
-    c->signal->unsubscribe(this);
+    if (captureSignals.find(c->signal) != captureSignals.end())
+        return;
+
+    activeSignalSet.erase(c->signal);
+    pendingSignals.insert(c->signal);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -118,205 +129,431 @@ void SubscriptionManager::clear()
     ChannelSubscriptionMap::const_iterator cit;
     SubscriptionGroup::const_iterator git;
 
-    activeSignals.clear();
+    clearTables();
 
     for (sit = signalSubscriptionMap.begin();
             sit != signalSubscriptionMap.end(); ++sit) {
+        // Signals used by captures stay subscribed
+        bool keep = captureSignals.find(sit->first) != captureSignals.end();
+        if (!keep) {
+            activeSignalSet.erase(sit->first);
+            pendingSignals.insert(sit->first);
+        }
+
         for (cit = sit->second.begin(); cit != sit->second.end(); ++cit) {
-            sit->first->unsubscribe(this);
             for (git = cit->second.begin(); git != cit->second.end(); ++git)
                 delete git->second;
         }
     }
 
     signalSubscriptionMap.clear();
+    commit();
+
+    // Captures are still there
+    dirty = !captures.empty();
 }
 
 /////////////////////////////////////////////////////////////////////////////
-void SubscriptionManager::newSignal( const PdServ::Signal *s)
+void SubscriptionManager::commit()
 {
-    SignalSubscriptionMap::const_iterator sit = signalSubscriptionMap.find(s);
+    std::vector<const PdServ::Signal*> required, released;
+
+    // A signal may have been subscribed and unsubscribed again in the
+    // meantime; only the final state counts
+    for (std::set<const PdServ::Signal*>::const_iterator it =
+            pendingSignals.begin(); it != pendingSignals.end(); ++it) {
+        if (signalSubscriptionMap.find(*it) != signalSubscriptionMap.end())
+            required.push_back(*it);
+        else if (captureSignals.find(*it) == captureSignals.end())
+            released.push_back(*it);
+    }
+    pendingSignals.clear();
 
-    // Find out whether this signal is used or whether sit is active already
-    if (sit == signalSubscriptionMap.end())
-        return;
+    if (!released.empty())
+        task->unsubscribe(this, &released[0], released.size());
+    if (!required.empty())
+        task->subscribe(this, &required[0], required.size());
+}
 
-    for (ChannelSubscriptionMap::const_iterator cit = sit->second.begin();
-            cit != sit->second.end(); ++cit) {
-        for (SubscriptionGroup::const_iterator git = cit->second.begin();
-                git != cit->second.end(); ++git) {
-
-            Subscription* s = git->second;
-
-            // Put subscription into active list
-            // Note: for event subscriptions, blocksize == 0
-            SubscriptionSet* g =
-                &activeSignals[git->first][s->decimation][s->blocksize];
-
-            if (g->empty()) {
-                // The blocksize group jas just been created, add data space for
-                // current time
-                g->time = new uint64_t[s->blocksize + !s->blocksize];
-                g->timePtr = g->time;
-                log_debug("s=%zu %zu:%zu:%zu %p", s->blocksize,
-                        git->first, s->decimation, s->blocksize, g->time);
-            }
+/////////////////////////////////////////////////////////////////////////////
+std::set<const PdServ::Signal*> SubscriptionManager::signals(
+        const Capture *capture)
+{
+    std::set<const PdServ::Signal*> set;
 
-            g->insert(s);
-        }
+    set.insert(capture->trigger->signal);
+    for (std::vector<const Channel*>::const_iterator it =
+            capture->channels.begin(); it != capture->channels.end(); ++it)
+        set.insert((*it)->signal);
+
+    return set;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void SubscriptionManager::addCapture(size_t group, Capture *capture)
+{
+    removeCapture(group);
+    captures[group] = capture;
+
+    std::set<const PdServ::Signal*> set(signals(capture));
+    for (std::set<const PdServ::Signal*>::const_iterator it = set.begin();
+            it != set.end(); ++it) {
+        ++captureSignals[*it];
+
+        // See subscribe(): newSignal() is called for active signals too
+        (*it)->subscribe(this);
     }
+
+    dirty = true;
 }
 
 /////////////////////////////////////////////////////////////////////////////
-void SubscriptionManager::remove (Subscription *s, size_t group)
+void SubscriptionManager::removeCapture(size_t group)
 {
-    // Find the map for the group
-    ActiveSignals::iterator git = activeSignals.find(group);
-    if (git == activeSignals.end())
+    CaptureMap::iterator it = captures.find(group);
+    if (it == captures.end())
         return;
 
-    // Find the decimation group
-    DecimationGroup::iterator dit = git->second.find(s->decimation);
-    if (dit == git->second.end())
-        return;
+    std::set<const PdServ::Signal*> set(signals(it->second));
+    for (std::set<const PdServ::Signal*>::const_iterator sit = set.begin();
+            sit != set.end(); ++sit)
+        releaseSignal(*sit);
 
-    // Find the blocksize group
-    BlocksizeGroup::iterator bit = dit->second.find(s->blocksize);
-    if (bit == dit->second.end())
-        return;
+    // The tables still refer to the capture. They are rebuilt before
+    // being used the next time
+    delete it->second;
+    captures.erase(it);
+    dirty = true;
+}
 
-    // Delete and remove subscription from set
-    delete s;
-    bit->second.erase(s);
-    if (!bit->second.empty())
+/////////////////////////////////////////////////////////////////////////////
+void SubscriptionManager::releaseSignal(const PdServ::Signal *s)
+{
+    std::map<const PdServ::Signal*, size_t>::iterator it =
+        captureSignals.find(s);
+
+    if (--it->second)
         return;
 
-    // blocksize group is empty, erase it
-    delete[] bit->second.time;
-    dit->second.erase(bit);
-    if (!dit->second.empty())
+    captureSignals.erase(it);
+
+    // Don't require signal any more, unless a subscription still uses it
+    if (signalSubscriptionMap.find(s) != signalSubscriptionMap.end())
         return;
 
-    // decimation group is empty, erase it
-    git->second.erase(dit);
-    if (!git->second.empty())
+    activeSignalSet.erase(s);
+    s->unsubscribe(this);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void SubscriptionManager::newSignal( const PdServ::Signal *s)
+{
+    // Find out whether this signal is used at all
+    if (signalSubscriptionMap.find(s) == signalSubscriptionMap.end()
+            and captureSignals.find(s) == captureSignals.end())
         return;
 
-    // group is emty, erase it
-    activeSignals.erase(git);
+    // Note: newSignal() is also called when a subscription is added to
+    // a signal that is active already
+    activeSignalSet.insert(s);
+    dirty = true;
 }
 
 /////////////////////////////////////////////////////////////////////////////
-void SubscriptionManager::rxPdo(bool quiet)
+void SubscriptionManager::remove (Subscription *s)
 {
-    ActiveSignals::iterator git;
-    DecimationGroup::iterator dit;
-    BlocksizeGroup::iterator bit;
-    SubscriptionSet::iterator sit;
-    Subscription* s;
-    Subscription* printQ, **printQEnd;
-    bool print;
+    // The tables still refer to s. They are rebuilt before being used
+    // the next time
+    delete s;
+    dirty = true;
+}
 
-    while (task->rxPdo(this, &taskTime, &taskStatistics)) {
-        if (quiet)
-            continue;
+/////////////////////////////////////////////////////////////////////////////
+void SubscriptionManager::clearTables()
+{
+    for (std::vector<BlockGroup>::iterator it = blockGroups.begin();
+            it != blockGroups.end(); ++it)
+        delete[] it->time;
+
+    decimationGroups.clear();
+    blockGroups.clear();
+    subscriptions.clear();
+    sources.clear();
+    aggregates.clear();
+    aggregateSources.clear();
+    activeCaptures.clear();
+    dirty = false;
+}
 
-        // Go through all groups
-        for (git = activeSignals.begin(); git != activeSignals.end(); ++git) {
+/////////////////////////////////////////////////////////////////////////////
+// Rebuild the tables of active subscriptions. Decimation counters and
+// time buffers of groups that exist before and after are retained.
+void SubscriptionManager::rebuild()
+{
+    // Sort active subscriptions by group, decimation and blocksize
+    typedef std::map<size_t, std::vector<Subscription*> > BlocksizeMap;
+    typedef std::map<size_t, BlocksizeMap> DecimationMap;
+    typedef std::map<size_t, DecimationMap> GroupMap;
+    GroupMap groupMap;
+
+    for (SignalSubscriptionMap::const_iterator sit =
+            signalSubscriptionMap.begin();
+            sit != signalSubscriptionMap.end(); ++sit) {
+        if (activeSignalSet.find(sit->first) == activeSignalSet.end())
+            continue;
 
-            // Go through all decimations
-            for (dit = git->second.begin(); dit != git->second.end(); ++dit) {
+        for (ChannelSubscriptionMap::const_iterator cit = sit->second.begin();
+                cit != sit->second.end(); ++cit) {
+            for (SubscriptionGroup::const_iterator git = cit->second.begin();
+                    git != cit->second.end(); ++git) {
+                Subscription* s = git->second;
 
-                // Check decimation counter
-                if (dit->second.busy(dit->first))
-                    continue;
+                // Note: for event subscriptions, blocksize == 0
+                groupMap[git->first][s->decimation][s->blocksize]
+                    .push_back(s);
+            }
+        }
+    }
 
-                // Go through all blocksizes
-                for (bit = dit->second.begin();
-                        bit != dit->second.end(); ++bit) {
-
-                    // Capture time
-                    *bit->second.timePtr =
-                        1000000000ULL * taskTime->tv_sec + taskTime->tv_nsec;
-
-                    // For non-event groups, increment timePtr and check
-                    // whether it points to the end
-                    print = false;
-                    if (bit->first) {
-                        ++bit->second.timePtr;
-                        print = (bit->second.time + bit->first)
-                            == bit->second.timePtr;
+    std::vector<DecimationGroup> oldDecimationGroups;
+    std::vector<BlockGroup> oldBlockGroups;
+    std::swap(oldDecimationGroups, decimationGroups);
+    std::swap(oldBlockGroups, blockGroups);
+    subscriptions.clear();
+    sources.clear();
+    aggregates.clear();
+    aggregateSources.clear();
+
+    // Both old and new decimation groups are sorted by group and
+    // decimation, so the old ones are found by walking along
+    std::vector<DecimationGroup>::const_iterator old =
+        oldDecimationGroups.begin();
+
+    for (GroupMap::const_iterator git = groupMap.begin();
+            git != groupMap.end(); ++git) {
+        for (DecimationMap::const_iterator dit = git->second.begin();
+                dit != git->second.end(); ++dit) {
+            DecimationGroup dg = {
+                git->first, dit->first, 0, blockGroups.size(), 0,
+                aggregates.size(), 0};
+
+            while (old != oldDecimationGroups.end()
+                    and (old->group < dg.group
+                        or (old->group == dg.group
+                            and old->decimation < dg.decimation)))
+                ++old;
+
+            bool found = old != oldDecimationGroups.end()
+                and old->group == dg.group
+                and old->decimation == dg.decimation;
+            if (found)
+                dg.counter = old->counter;
+
+            for (BlocksizeMap::const_iterator bit = dit->second.begin();
+                    bit != dit->second.end(); ++bit) {
+                BlockGroup bg = {
+                    bit->first, 0, 0, subscriptions.size(), 0};
+
+                for (size_t i = found ? old->blockBegin : 0;
+                        found and i != old->blockEnd; ++i) {
+                    if (oldBlockGroups[i].blocksize == bg.blocksize) {
+                        std::swap(bg.time, oldBlockGroups[i].time);
+                        bg.timePtr = oldBlockGroups[i].timePtr;
+                        break;
                     }
+                }
+
+                if (!bg.time) {
+                    // Data space for the time of every block
+                    bg.time = new uint64_t[bg.blocksize + !bg.blocksize];
+                    bg.timePtr = bg.time;
+                }
+
+                for (std::vector<Subscription*>::const_iterator it =
+                        bit->second.begin(); it != bit->second.end(); ++it) {
+                    subscriptions.push_back(*it);
+                    sources.push_back((*it)->channel->signal);
 
-                    // Prepare print queue
-                    printQ = 0;
-                    printQEnd = &printQ;
-
-                    // Go through all subscriptions
-                    for (sit = bit->second.begin();
-                            sit != bit->second.end(); ++sit) {
-                        s = *sit;
-                        const char *data = s->channel->signal->getValue(this);
-
-                        if ((s->newValue(data) and !bit->first) or print) {
-                            *printQEnd = s;
-                            printQEnd = &s->next;
-                            s->next = 0;    // Sentinel
-                        }
+                    if ((*it)->aggregating()) {
+                        aggregates.push_back(*it);
+                        aggregateSources.push_back((*it)->channel->signal);
                     }
+                }
+
+                bg.subEnd = subscriptions.size();
+                blockGroups.push_back(bg);
+            }
 
-                    // Check if any signals need printing
-                    if (printQ) {
-                        XmlElement dataTag(session->createElement("data"));
-                        if (git->first)
-                            XmlElement::Attribute(dataTag, "group")
-                                << git->first;
+            dg.blockEnd = blockGroups.size();
+            dg.aggEnd = aggregates.size();
+            decimationGroups.push_back(dg);
+        }
+    }
 
-                        XmlElement::Attribute(dataTag, "level") << 0;
-                        XmlElement::Attribute(dataTag, "time") << *taskTime;
+    // Free time buffers that were not taken over
+    for (std::vector<BlockGroup>::iterator it = oldBlockGroups.begin();
+            it != oldBlockGroups.end(); ++it)
+        delete[] it->time;
 
-                        // Print time channel
-                        {
-                            size_t len = sizeof(uint64_t)
-                                * (bit->first + !bit->first);
+    printQueue.reserve(subscriptions.size());
 
-                            XmlElement time(dataTag.createChild("time"));
-                            XmlElement::Attribute value(time, "d");
-                            value.base64(bit->second.time, len);
-                        }
+    // Captures are only run when all their signals are active
+    activeCaptures.clear();
+    for (CaptureMap::const_iterator it = captures.begin();
+            it != captures.end(); ++it) {
+        std::set<const PdServ::Signal*> set(signals(it->second));
+        std::set<const PdServ::Signal*>::const_iterator sit;
 
-                        // Reset timePtr
-                        bit->second.timePtr = bit->second.time;
+        for (sit = set.begin(); sit != set.end(); ++sit)
+            if (activeSignalSet.find(*sit) == activeSignalSet.end())
+                break;
 
-                        // Print every subscription
-                        for (s = printQ; s; s = s->next)
-                            s->print(dataTag);
-                    }
+        if (sit == set.end())
+            activeCaptures.push_back(*it);
+    }
+
+    dirty = false;
+
+    log_debug("%zu decimation groups, %zu block groups, %zu subscriptions, "
+            "%zu captures",
+            decimationGroups.size(), blockGroups.size(),
+            subscriptions.size(), activeCaptures.size());
+}
+
+/////////////////////////////////////////////////////////////////////////////
+size_t SubscriptionManager::rxPdo(bool quiet, size_t reduction)
+{
+    std::vector<DecimationGroup>::iterator dg;
+    std::vector<BlockGroup>::iterator bg, bgEnd;
+    bool print;
+    size_t skipped = 0;
+
+    while (task->rxPdo(this, &taskTime, &taskStatistics)) {
+        // Signals may have become active while receiving the PDO
+        if (dirty)
+            rebuild();
+
+        const uint64_t time =
+            1000000000ULL * taskTime->tv_sec + taskTime->tv_nsec;
+
+        // Captures record every sample, regardless of reduction.
+        // Completed windows are discarded while quiet
+        finishedCaptures.clear();
+        for (std::vector<std::pair<size_t, Capture*> >::const_iterator it =
+                activeCaptures.begin(); it != activeCaptures.end(); ++it) {
+            Capture *c = it->second;
+            if (!c->newSample(this, time))
+                continue;
+
+            if (!quiet) {
+                XmlElement captureTag(session->createElement("capture"));
+                if (it->first)
+                    XmlElement::Attribute(captureTag, "group") << it->first;
+                c->print(captureTag);
+            }
+            else
+                c->rearm();
+
+            if (!c->repeat)
+                finishedCaptures.push_back(it->first);
+        }
+
+        for (std::vector<size_t>::const_iterator it =
+                finishedCaptures.begin(); it != finishedCaptures.end(); ++it)
+            removeCapture(*it);
+
+        if (quiet or ++frameCount % reduction) {
+            ++skipped;
+            continue;
+        }
+
+        // Go through all decimation groups
+        for (dg = decimationGroups.begin();
+                dg != decimationGroups.end(); ++dg) {
+
+            // Aggregating subscriptions see every sample
+            for (size_t i = dg->aggBegin; i != dg->aggEnd; ++i)
+                aggregates[i]->accumulate(
+                        aggregateSources[i]->getValue(this));
+
+            // Check decimation counter
+            if (!dg->counter)
+                dg->counter = dg->decimation;
+            if (--dg->counter)
+                continue;
+
+            // Go through all blocksizes
+            bgEnd = blockGroups.begin() + dg->blockEnd;
+            for (bg = blockGroups.begin() + dg->blockBegin;
+                    bg != bgEnd; ++bg) {
+
+                // Capture time
+                *bg->timePtr = time;
+
+                // For non-event groups, increment timePtr and check
+                // whether it points to the end
+                print = false;
+                if (bg->blocksize) {
+                    ++bg->timePtr;
+                    print = (bg->time + bg->blocksize) == bg->timePtr;
                 }
+
+                // Go through all subscriptions, preparing print queue
+                printQueue.clear();
+                for (size_t i = bg->subBegin; i != bg->subEnd; ++i) {
+                    Subscription* s = subscriptions[i];
+
+                    if ((s->newValue(sources[i]->getValue(this))
+                                and !bg->blocksize) or print)
+                        printQueue.push_back(s);
+                }
+
+                // Check if any signals need printing
+                if (printQueue.empty())
+                    continue;
+
+                XmlElement dataTag(session->createElement("data"));
+                if (dg->group)
+                    XmlElement::Attribute(dataTag, "group") << dg->group;
+
+                XmlElement::Attribute(dataTag, "level") << 0;
+                XmlElement::Attribute(dataTag, "time") << *taskTime;
+
+                // Print time channel
+                {
+                    size_t len = sizeof(uint64_t)
+                        * (bg->blocksize + !bg->blocksize);
+
+                    XmlElement time(dataTag.createChild("time"));
+                    XmlElement::Attribute value(time, "d");
+                    value.base64(bg->time, len);
+                }
+
+                // Reset timePtr
+                bg->timePtr = bg->time;
+
+                // Print every subscription
+                for (std::vector<Subscription*>::const_iterator it =
+                        printQueue.begin(); it != printQueue.end(); ++it)
+                    (*it)->print(dataTag);
             }
         }
     }
+
+    return skipped;
 }
 
 /////////////////////////////////////////////////////////////////////////////
 void SubscriptionManager::sync()
 {
-    ActiveSignals::iterator git;
-    DecimationGroup::iterator dit;
-    BlocksizeGroup::iterator bit;
-    SubscriptionSet::iterator sit;
-
-    for (git = activeSignals.begin();
-            git != activeSignals.end(); ++git) {
-        for (dit = git->second.begin();
-                dit != git->second.end(); ++dit) {
-            for (bit = dit->second.begin();
-                    bit != dit->second.end(); ++bit) {
-                bit->second.timePtr = bit->second.time;
-                for (sit = bit->second.begin();
-                        sit != bit->second.end(); ++sit)
-                    (*sit)->reset();
-            }
-        }
-    }
+    if (dirty)
+        rebuild();
+
+    for (std::vector<BlockGroup>::iterator it = blockGroups.begin();
+            it != blockGroups.end(); ++it)
+        it->timePtr = it->time;
+
+    for (std::vector<Subscription*>::const_iterator it =
+            subscriptions.begin(); it != subscriptions.end(); ++it)
+        (*it)->reset();
 }
@@ -28,6 +28,8 @@
 
 #include <set>
 #include <map>
+#include <vector>
+#include <stdint.h>
 
 namespace PdServ {
     class Task;
@@ -37,8 +39,10 @@ namespace PdServ {
 namespace MsrProto {
 
 class Channel;
+class Capture;
 class Subscription;
 class Session;
+struct SubscriptionOptions;
 
 class SubscriptionManager: public PdServ::SessionTask {
     public:
@@ -47,16 +51,28 @@ class SubscriptionManager: public PdServ::SessionTask {
 
         Session * const session;
 
-        void rxPdo(bool quiet);
+        // Process all pending data frames. Only every reduction'th frame
+        // is sent to the client, none at all when quiet is set.
+        // Returns the number of frames that were not sent
+        size_t rxPdo(bool quiet, size_t reduction = 1);
 
         void clear();
         void unsubscribe(const Channel *s, size_t group);
         void subscribe(const Channel *s, size_t group,
                 size_t decimation, size_t blocksize,
-                bool base64, std::streamsize precision);
+                bool base64, std::streamsize precision,
+                const SubscriptionOptions& options);
+
+        // Pass the signals of the subscriptions that changed since the
+        // last call on to the task in one go
+        void commit();
 
         void sync();
 
+        // Take over capture, replacing one of the same group
+        void addCapture(size_t group, Capture *capture);
+        void removeCapture(size_t group);
+
         const struct timespec *taskTime;
         const PdServ::TaskStatistics *taskStatistics;
 
@@ -64,6 +80,8 @@ class SubscriptionManager: public PdServ::SessionTask {
         static struct timespec dummyTime;
         static PdServ::TaskStatistics dummyTaskStatistics;
 
+        size_t frameCount;
+
         // Here is a map of all subscribed channels. Organization:
         // signalSubscriptionMap
         //                      -> [signal]
@@ -77,37 +95,66 @@ class SubscriptionManager: public PdServ::SessionTask {
             SignalSubscriptionMap;
         SignalSubscriptionMap signalSubscriptionMap;
 
-        // Here is a template class that implements a decimation counter
-        template <class T>
-            struct DecimationCounter: std::map<size_t, T> {
-                DecimationCounter(): counter(0) {}
-                bool busy(size_t start) {
-                    if (!counter)
-                        counter = start;
-                    return --counter;
-                }
-                size_t counter;
-            };
-
-        // Here are the active signals, those that are transferred via shmem.
-        // Organization: activeSignals
-        //                      -> [group]
-        //                      -> [decimation]
-        //                      -> [blocksize]
-        //                      -> subscriptionSet
-        //                      -> subscription
-        struct SubscriptionSet: std::set<Subscription*> {
-            uint64_t *time;
-            uint64_t *timePtr;
-        };
-        typedef DecimationCounter<SubscriptionSet> BlocksizeGroup;
-        typedef std::map<size_t, BlocksizeGroup> DecimationGroup;
-        typedef std::map<size_t, DecimationGroup> ActiveSignals;
-        ActiveSignals activeSignals;
-
+        // Signals that are transferred via shmem
         std::set<const PdServ::Signal*> activeSignalSet;
 
-        void remove(Subscription *s, size_t group);
+        // Signals whose subscriptions changed until commit()
+        std::set<const PdServ::Signal*> pendingSignals;
+
+        // Here are the active subscriptions, those whose signal is
+        // transferred via shmem, in flat tables that are rebuilt when
+        // the subscriptions change. rxPdo() scans them linearly.
+        //
+        // Organization:
+        //      decimationGroups: sorted by (group, decimation)
+        //                      -> [blockBegin, blockEnd) of blockGroups
+        //      blockGroups: sorted by blocksize within decimation group
+        //                      -> [subBegin, subEnd) of subscriptions
+        //      subscriptions/sources: parallel arrays
+        //      aggregates/aggregateSources: parallel arrays of aggregating
+        //                      subscriptions that see every sample
+        struct DecimationGroup {
+            size_t group;
+            size_t decimation;
+            size_t counter;
+            size_t blockBegin, blockEnd;
+            size_t aggBegin, aggEnd;
+        };
+        struct BlockGroup {
+            size_t blocksize;           // 0 for event subscriptions
+            uint64_t *time;             // blocksize + !blocksize entries
+            uint64_t *timePtr;
+            size_t subBegin, subEnd;
+        };
+        std::vector<DecimationGroup> decimationGroups;
+        std::vector<BlockGroup> blockGroups;
+        std::vector<Subscription*> subscriptions;
+        std::vector<const PdServ::Signal*> sources;
+        std::vector<Subscription*> aggregates;
+        std::vector<const PdServ::Signal*> aggregateSources;
+
+        // Subscriptions that have to be printed in the current cycle
+        std::vector<Subscription*> printQueue;
+
+        // Triggered captures by group. Signals used by captures are
+        // reference counted so that they stay subscribed while either
+        // a subscription or a capture requires them
+        typedef std::map<size_t, Capture*> CaptureMap;
+        CaptureMap captures;
+        std::map<const PdServ::Signal*, size_t> captureSignals;
+
+        // Captures whose signals are all active
+        std::vector<std::pair<size_t, Capture*> > activeCaptures;
+        std::vector<size_t> finishedCaptures;
+
+        static std::set<const PdServ::Signal*> signals(const Capture *);
+        void releaseSignal(const PdServ::Signal *);
+
+        bool dirty;     // Tables have to be rebuilt
+        void rebuild();
+        void clearTables();
+
+        void remove(Subscription *s);
 
         // Reimplemented from PdServ::SessionTask
         void newSignal( const PdServ::Signal *);
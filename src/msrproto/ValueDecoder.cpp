@@ -0,0 +1,550 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include "ValueDecoder.h"
+#include "../DataType.h"
+
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <locale>
+#include <limits>
+#include <stdint.h>
+#include <strings.h>    // strncasecmp()
+
+using namespace MsrProto;
+
+/////////////////////////////////////////////////////////////////////////////
+ValueDecoder::ValueDecoder()
+{
+    dtype = 0;
+    wire = 0;
+    swap = false;
+    buf = 0;
+    bufSize = 0;
+    pos = 0;
+    end = 0;
+    convBuf = 0;
+    convBufSize = 0;
+    convSize = 0;
+    error = false;
+    tokenLen = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+ValueDecoder::~ValueDecoder()
+{
+    delete[] buf;
+    delete[] convBuf;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void ValueDecoder::reset(const PdServ::DataType& dtype, size_t nelem,
+        Coding coding, const PdServ::DataType* wire, bool swap)
+{
+    if (coding != Base64 or !wire) {
+        wire = &dtype;
+        swap = false;
+    }
+    else if (wire->primary() == dtype.primary())
+        wire = &dtype;
+
+    size_t size = nelem * wire->size;
+
+    // The staging buffers are kept for the next value
+    if (size > bufSize) {
+        delete[] buf;
+        buf = new char[size];
+        bufSize = size;
+    }
+
+    if (wire != &dtype and nelem * dtype.size > convBufSize) {
+        delete[] convBuf;
+        convBufSize = nelem * dtype.size;
+        convBuf = new char[convBufSize];
+    }
+
+    this->dtype = &dtype;
+    this->wire = wire;
+    this->swap = swap;
+    this->coding = coding;
+    pos = buf;
+    end = buf + size;
+    convSize = 0;
+    error = false;
+    tokenLen = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const char* ValueDecoder::data() const
+{
+    return wire == dtype ? buf : convBuf;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+size_t ValueDecoder::size() const
+{
+    return wire == dtype ? pos - buf : convSize;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+int ValueDecoder::hexDigit(char c)
+{
+    if (c >= '0' and c <= '9')
+        return c - '0';
+    if (c >= 'a' and c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' and c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void ValueDecoder::write(const char* s, size_t n)
+{
+    const char* const sEnd = s + n;
+
+    if (error)
+        return;
+
+    if (coding == Base64) {
+        base64(s, sEnd);
+        return;
+    }
+
+    if (coding == Hex) {
+        for (; s != sEnd and pos != end; ++s) {
+            int d = hexDigit(*s);
+            if (d < 0) {
+                error = true;
+                return;
+            }
+
+            // token[0] holds the high nibble
+            if (tokenLen) {
+                *pos++ = (token[0] << 4) | d;
+                tokenLen = 0;
+            }
+            else {
+                token[0] = d;
+                tokenLen = 1;
+            }
+        }
+        return;
+    }
+
+    for (; s != sEnd; ++s) {
+        switch (*s) {
+            case ',': case ';':
+            case ' ': case '\t': case '\r': case '\n':
+                if (tokenLen)
+                    number();
+                break;
+
+            default:
+                if (tokenLen == sizeof(token)) {
+                    error = true;
+                    return;
+                }
+                token[tokenLen++] = *s;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Decode groups of 4 characters to 3 bytes. An incomplete group is
+// kept in token
+void ValueDecoder::base64(const char* s, const char* sEnd)
+{
+    for (; s != sEnd; ++s) {
+        char c = *s;
+        int v;
+
+        if (c >= 'A' and c <= 'Z')
+            v = c - 'A';
+        else if (c >= 'a' and c <= 'z')
+            v = c - 'a' + 26;
+        else if (c >= '0' and c <= '9')
+            v = c - '0' + 52;
+        else if (c == '+')
+            v = 62;
+        else if (c == '/')
+            v = 63;
+        else if (c == '=' or c == ' ' or c == '\t'
+                or c == '\r' or c == '\n')
+            continue;   // Padding is implied by the length
+        else {
+            error = true;
+            return;
+        }
+
+        token[tokenLen++] = v;
+        if (tokenLen < 4)
+            continue;
+
+        unsigned char b[3] = {
+            uint8_t(token[0] << 2 | token[1] >> 4),
+            uint8_t(token[1] << 4 | token[2] >> 2),
+            uint8_t(token[2] << 6 | token[3]),
+        };
+        for (size_t i = 0; i < 3 and pos != end; ++i)
+            *pos++ = b[i];
+
+        tokenLen = 0;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void ValueDecoder::number()
+{
+    double v;
+
+    if (!parseDouble(token, token + tokenLen, v))
+        error = true;
+    else if (pos != end)
+        dtype->setValue(pos, v);
+
+    tokenLen = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool ValueDecoder::finish()
+{
+    if (coding == Csv and tokenLen)
+        number();
+    else if (coding == Hex and tokenLen)
+        error = true;
+    else if (coding == Base64 and tokenLen) {
+        // The last group has 2 or 3 characters for 1 or 2 bytes
+        if (tokenLen == 1)
+            error = true;
+        else {
+            std::fill(token + tokenLen, token + 4, 0);
+            unsigned char b[2] = {
+                uint8_t(token[0] << 2 | token[1] >> 4),
+                uint8_t(token[1] << 4 | token[2] >> 2),
+            };
+            for (size_t i = 0; i < tokenLen - 1 and pos != end; ++i)
+                *pos++ = b[i];
+        }
+        tokenLen = 0;
+    }
+
+    if (error or coding != Base64)
+        return !error;
+
+    // Only complete elements are used
+    size_t nelem = (pos - buf) / wire->size;
+    pos = buf + nelem * wire->size;
+
+    if (swap)
+        swapBytes(buf, wire->size, nelem);
+
+    if (wire != dtype) {
+        convert(*wire, buf, *dtype, convBuf, nelem);
+        convSize = nelem * dtype->size;
+    }
+
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const PdServ::DataType* ValueDecoder::findType(const char* typ)
+{
+    static const struct {
+        const char* name;
+        const PdServ::DataType& dtype;
+    } types[] = {
+        {"TCHAR",   PdServ::DataType::int8},
+        {"TUCHAR",  PdServ::DataType::uint8},
+        {"TSHORT",  PdServ::DataType::int16},
+        {"TUSHORT", PdServ::DataType::uint16},
+        {"TINT",    PdServ::DataType::int32},
+        {"TUINT",   PdServ::DataType::uint32},
+        {"TLINT",   PdServ::DataType::int64},
+        {"TULINT",  PdServ::DataType::uint64},
+        {"TDBL",    PdServ::DataType::float64},
+        {"TFLT",    PdServ::DataType::float32},
+    };
+
+    for (size_t i = 0; i < sizeof(types) / sizeof(*types); ++i)
+        if (!strcasecmp(typ, types[i].name))
+            return &types[i].dtype;
+
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool ValueDecoder::needsSwap(const char* endian)
+{
+    static const uint16_t one = 1;
+    bool little = *reinterpret_cast<const uint8_t*>(&one);
+
+    return little
+        ? !strcasecmp(endian, "big")
+        : !strcasecmp(endian, "little");
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Separate loops per element size, so that the compiler can vectorize
+// them
+void ValueDecoder::swapBytes(char* buf, size_t size, size_t nelem)
+{
+    switch (size) {
+        case 2:
+            {
+                uint16_t* p = reinterpret_cast<uint16_t*>(buf);
+                for (size_t i = 0; i < nelem; ++i)
+                    p[i] = __builtin_bswap16(p[i]);
+            }
+            break;
+
+        case 4:
+            {
+                uint32_t* p = reinterpret_cast<uint32_t*>(buf);
+                for (size_t i = 0; i < nelem; ++i)
+                    p[i] = __builtin_bswap32(p[i]);
+            }
+            break;
+
+        case 8:
+            {
+                uint64_t* p = reinterpret_cast<uint64_t*>(buf);
+                for (size_t i = 0; i < nelem; ++i)
+                    p[i] = __builtin_bswap64(p[i]);
+            }
+            break;
+
+        default:
+            for (size_t i = 0; i < nelem; ++i, buf += size)
+                std::reverse(buf, buf + size);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Typed conversion loops for every pair of primary types. Integers are
+// cast directly, so that 64 bit values are not rounded through double.
+// The data may not be aligned; memcpy() of a single element compiles
+// to a plain load or store
+namespace {
+    template <class From, class To>
+        void convertLoop(const char* src, char* dst, size_t nelem)
+        {
+            for (size_t i = 0; i < nelem; ++i) {
+                From f;
+                std::memcpy(&f, src + i * sizeof(From), sizeof(From));
+                To t = static_cast<To>(f);
+                std::memcpy(dst + i * sizeof(To), &t, sizeof(To));
+            }
+        }
+
+    template <class From>
+        bool convertFrom(const char* src,
+                PdServ::DataType::Primary to, char* dst, size_t nelem)
+        {
+            switch (to) {
+                case PdServ::DataType::boolean_T:
+                    convertLoop<From,     bool>(src, dst, nelem); break;
+                case PdServ::DataType::uint8_T:
+                    convertLoop<From,  uint8_t>(src, dst, nelem); break;
+                case PdServ::DataType::int8_T:
+                    convertLoop<From,   int8_t>(src, dst, nelem); break;
+                case PdServ::DataType::uint16_T:
+                    convertLoop<From, uint16_t>(src, dst, nelem); break;
+                case PdServ::DataType::int16_T:
+                    convertLoop<From,  int16_t>(src, dst, nelem); break;
+                case PdServ::DataType::uint32_T:
+                    convertLoop<From, uint32_t>(src, dst, nelem); break;
+                case PdServ::DataType::int32_T:
+                    convertLoop<From,  int32_t>(src, dst, nelem); break;
+                case PdServ::DataType::uint64_T:
+                    convertLoop<From, uint64_t>(src, dst, nelem); break;
+                case PdServ::DataType::int64_T:
+                    convertLoop<From,  int64_t>(src, dst, nelem); break;
+                case PdServ::DataType::double_T:
+                    convertLoop<From,   double>(src, dst, nelem); break;
+                case PdServ::DataType::single_T:
+                    convertLoop<From,    float>(src, dst, nelem); break;
+                default:
+                    return false;
+            }
+            return true;
+        }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void ValueDecoder::convert(const PdServ::DataType& from, const char* src,
+        const PdServ::DataType& to, char* dst, size_t nelem)
+{
+    if (&from == &to or from.primary() == to.primary()) {
+        std::copy(src, src + nelem * from.size, dst);
+        return;
+    }
+
+    bool done;
+    switch (from.primary()) {
+        case PdServ::DataType::boolean_T:
+            done = convertFrom<    bool>(src, to.primary(), dst, nelem);
+            break;
+        case PdServ::DataType::uint8_T:
+            done = convertFrom< uint8_t>(src, to.primary(), dst, nelem);
+            break;
+        case PdServ::DataType::int8_T:
+            done = convertFrom<  int8_t>(src, to.primary(), dst, nelem);
+            break;
+        case PdServ::DataType::uint16_T:
+            done = convertFrom<uint16_t>(src, to.primary(), dst, nelem);
+            break;
+        case PdServ::DataType::int16_T:
+            done = convertFrom< int16_t>(src, to.primary(), dst, nelem);
+            break;
+        case PdServ::DataType::uint32_T:
+            done = convertFrom<uint32_t>(src, to.primary(), dst, nelem);
+            break;
+        case PdServ::DataType::int32_T:
+            done = convertFrom< int32_t>(src, to.primary(), dst, nelem);
+            break;
+        case PdServ::DataType::uint64_T:
+            done = convertFrom<uint64_t>(src, to.primary(), dst, nelem);
+            break;
+        case PdServ::DataType::int64_T:
+            done = convertFrom< int64_t>(src, to.primary(), dst, nelem);
+            break;
+        case PdServ::DataType::double_T:
+            done = convertFrom<  double>(src, to.primary(), dst, nelem);
+            break;
+        case PdServ::DataType::single_T:
+            done = convertFrom<   float>(src, to.primary(), dst, nelem);
+            break;
+        default:
+            done = false;
+    }
+
+    if (done)
+        return;
+
+    // Not a primary type: element by element through double
+    union {
+        char c[PdServ::DataType::maxWidth];
+        uint64_t align;
+    } tmp;
+    for (size_t i = 0; i < nelem; ++i, src += from.size) {
+        std::copy(src, src + from.size, tmp.c);
+        to.setValue(dst, from.getValue(tmp.c));
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Numbers with at most 15 significant digits and a decimal exponent of
+// at most 22 are exactly representable as m * 10^e or m / 10^e in a
+// double, so a single multiplication or division is correctly rounded
+// (Clinger's fast path). Everything else is left to the stream library
+bool ValueDecoder::parseDouble(const char* s, const char* end,
+        double& value)
+{
+    static const double pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char* p = s;
+    bool negative = false;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool fast = true;
+    bool any = false;
+
+    if (p != end and (*p == '-' or *p == '+'))
+        negative = *p++ == '-';
+
+    // The stream library does not know inf and nan
+    if (p != end and !(*p >= '0' and *p <= '9') and *p != '.') {
+        size_t len = end - p;
+        if ((len == 3 or len == 8)
+                and !strncasecmp(p, "infinity", len)) {
+            value = negative ? -std::numeric_limits<double>::infinity()
+                : std::numeric_limits<double>::infinity();
+            return true;
+        }
+        else if (len == 3 and !strncasecmp(p, "nan", len)) {
+            value = std::numeric_limits<double>::quiet_NaN();
+            return true;
+        }
+
+        return false;
+    }
+
+    for (; p != end and *p >= '0' and *p <= '9'; ++p) {
+        any = true;
+        if (mantissa or *p != '0') {
+            mantissa = 10 * mantissa + (*p - '0');
+            fast = fast and ++digits <= 15;
+        }
+    }
+
+    if (p != end and *p == '.') {
+        for (++p; p != end and *p >= '0' and *p <= '9'; ++p) {
+            any = true;
+            if (mantissa or *p != '0') {
+                mantissa = 10 * mantissa + (*p - '0');
+                fast = fast and ++digits <= 15;
+            }
+            --exponent;
+        }
+    }
+
+    if (any and p != end and (*p == 'e' or *p == 'E')) {
+        bool negExp = false;
+        int e = 0;
+
+        ++p;
+        if (p != end and (*p == '-' or *p == '+'))
+            negExp = *p++ == '-';
+
+        if (p == end or *p < '0' or *p > '9')
+            return false;
+
+        for (; p != end and *p >= '0' and *p <= '9'; ++p)
+            e = std::min(10 * e + (*p - '0'), 10000);
+
+        exponent += negExp ? -e : e;
+    }
+
+    if (fast and any and p == end
+            and exponent >= -22 and exponent <= 22) {
+        value = exponent < 0
+            ? double(mantissa) / pow10[-exponent]
+            : double(mantissa) * pow10[exponent];
+        if (negative)
+            value = -value;
+        return true;
+    }
+
+    // Slow path for many digits and large exponents
+    std::istringstream is(std::string(s, end));
+    is.imbue(std::locale::classic());
+    is >> value;
+
+    return !is.fail() and is.peek() == std::char_traits<char>::eof();
+}
@@ -0,0 +1,116 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#ifndef VALUEDECODER_H
+#define VALUEDECODER_H
+
+#include <cstddef>
+
+namespace PdServ {
+    class DataType;
+}
+
+namespace MsrProto {
+
+/* Incremental decoder for parameter values.
+ *
+ * The text of a value is passed to write() in arbitrary pieces as it
+ * arrives. It is decoded straight into a staging buffer of at most
+ * nelem elements, so that the text never needs to be held in memory
+ * as a whole. Elements beyond nelem are ignored.
+ *
+ * Csv:    numbers separated by ',', ';' or white space, parsed without
+ *         regard to the locale
+ * Hex:    two hexadecimal digits per byte of raw data
+ * Base64: raw data of elements of type wire in the given byte order.
+ *         finish() converts them to dtype in native byte order
+ */
+class ValueDecoder {
+    public:
+        enum Coding {Csv, Hex, Base64};
+
+        ValueDecoder();
+        ~ValueDecoder();
+
+        // wire is only used for Base64. It defaults to dtype
+        void reset(const PdServ::DataType& dtype, size_t nelem,
+                Coding coding,
+                const PdServ::DataType* wire = 0, bool swap = false);
+
+        void write(const char* s, size_t n);
+
+        // Finish decoding. Returns false on invalid input
+        bool finish();
+
+        const char* data() const;
+        size_t size() const;            // Bytes decoded
+
+        // Parse a number in [begin, end). Exposed for testing
+        static bool parseDouble(const char* begin, const char* end,
+                double& value);
+
+        // Primary data type for the name used in the "typ" attribute,
+        // e.g. TDBL. Returns 0 if unknown
+        static const PdServ::DataType* findType(const char* typ);
+
+        // Whether data in the byte order "little" or "big" needs to be
+        // swapped. Returns false for any other name
+        static bool needsSwap(const char* endian);
+
+        // Convert nelem elements between primary data types. src and
+        // dst must not overlap
+        static void convert(const PdServ::DataType& from, const char* src,
+                const PdServ::DataType& to, char* dst, size_t nelem);
+
+        // Reverse the byte order of nelem elements of size bytes
+        static void swapBytes(char* buf, size_t size, size_t nelem);
+
+    private:
+        const PdServ::DataType* dtype;
+        const PdServ::DataType* wire;
+        bool swap;
+        Coding coding;
+
+        char* buf;
+        size_t bufSize;
+        char* pos;
+        const char* end;
+
+        // Native data when converting from wire
+        char* convBuf;
+        size_t convBufSize;
+        size_t convSize;
+
+        bool error;
+
+        // Incomplete token at the end of the last piece
+        char token[64];
+        size_t tokenLen;
+
+        void number();
+        void base64(const char* s, const char* sEnd);
+        static int hexDigit(char c);
+};
+
+}
+
+#endif // VALUEDECODER_H
@@ -24,8 +24,77 @@
 #include "Variable.h"
 #include "XmlElement.h"
 
+#include <sstream>
+#include <cc++/thread.h>
+
 using namespace MsrProto;
 
+namespace {
+    const size_t scalar = 1;
+
+    // Guards the elements of all variables. Sessions create them
+    // concurrently
+    ost::Mutex elementMutex;
+
+    std::string decimal(size_t n)
+    {
+        char buf[20];
+        char* p = buf + sizeof(buf);
+
+        do {
+            *--p = '0' + n % 10;
+            n /= 10;
+        } while (n);
+
+        return std::string(p, buf + sizeof(buf));
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////
+// The elements of the row at depth that begins with element start
+class Variable::ElementDir: public DirectoryNode {
+    public:
+        ElementDir(const Variable* variable, DirectoryNode* parent,
+                size_t depth, size_t start);
+
+    private:
+        const Variable* const variable;
+        const size_t depth;
+        const size_t start;
+        const std::string name;
+
+        // Reimplemented from DirectoryNode
+        size_t virtualChildCount() const;
+        const DirectoryNode* virtualChild(size_t n,
+                TempNode* tmp) const;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+Variable::ElementDir::ElementDir(const Variable* variable,
+        DirectoryNode* parent, size_t depth, size_t start):
+    variable(variable), depth(depth), start(start),
+    name(decimal(start / variable->stride(depth)
+                % variable->dim[depth - 1]))
+{
+    rename(name.c_str(), parent);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+size_t Variable::ElementDir::virtualChildCount() const
+{
+    return variable->dim[depth];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const DirectoryNode* Variable::ElementDir::virtualChild(size_t n,
+        TempNode* tmp) const
+{
+    return variable->elementNode(depth + 1,
+            start + n * variable->stride(depth + 1), tmp);
+}
+
+/////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
 Variable::Variable (const PdServ::Variable* v, size_t index,
         const PdServ::DataType& dtype, const PdServ::DataType::DimType& dim,
@@ -33,8 +102,125 @@ Variable::Variable (const PdServ::Variable* v, size_t index,
     variable(v), index(index),
     dtype(dtype), dim(dim), offset(offset),
     memSize(dtype.size * dim.nelem),
-    hidden(false)
+    hidden(false), elementMap(0)
+{
+    attributeCache[0] = 0;
+    attributeCache[1] = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+Variable::Variable (const Variable* parent, size_t n):
+    variable(parent->variable), index(parent->index + 1 + n),
+    dtype(parent->dtype), dim(1, &scalar),
+    offset(parent->offset + n * parent->dtype.size),
+    memSize(parent->dtype.size),
+    hidden(parent->hidden), elementMap(0)
 {
+    attributeCache[0] = 0;
+    attributeCache[1] = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+Variable::~Variable()
+{
+    delete attributeCache[0];
+    delete attributeCache[1];
+
+    if (elementMap) {
+        for (ElementMap::iterator it = elementMap->begin();
+                it != elementMap->end(); ++it)
+            delete it->second;
+        delete elementMap;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Variable::split()
+{
+    if (!elementMap and !dim.isScalar())
+        elementMap = new ElementMap;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+size_t Variable::elementCount() const
+{
+    return elementMap ? dim.nelem : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Number of elements of a row at depth
+size_t Variable::stride(size_t depth) const
+{
+    size_t n = 1;
+    for (; depth < dim.size(); ++depth)
+        n *= dim[depth];
+    return n;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const Variable* Variable::element(size_t n,
+        TempNode* tmp) const
+{
+    return n < elementCount()
+        ? static_cast<const Variable*>(elementNode(dim.size(), n, tmp))
+        : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Node at depth below this variable that contains element start. The
+// directories above it are created as well
+const DirectoryNode* Variable::elementNode(size_t depth, size_t start,
+        TempNode* tmp) const
+{
+    ost::MutexLock lock(elementMutex);
+
+    // Nodes only refer to their parent for the path
+    DirectoryNode* dir = const_cast<Variable*>(this);
+
+    for (size_t d = 1; d <= depth; ++d) {
+        const std::pair<size_t, size_t> key(d, start - start % stride(d));
+
+        ElementMap::const_iterator it = elementMap->find(key);
+        if (it != elementMap->end()) {
+            dir = it->second;
+            continue;
+        }
+
+        DirectoryNode* node;
+        if (d < dim.size())
+            node = new ElementDir(this, dir, d, key.second);
+        else {
+            Variable* v = createElement(key.second);
+            v->elementName = decimal(key.second % dim.back());
+            v->rename(v->elementName.c_str(), dir);
+
+            // Not kept; the caller uses it temporarily
+            if (tmp) {
+                tmp->reset(v);
+                return v;
+            }
+
+            node = v;
+        }
+
+        elementMap->insert(std::make_pair(key, node));
+        dir = node;
+    }
+
+    return dir;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+size_t Variable::virtualChildCount() const
+{
+    return elementMap ? dim[0] : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const DirectoryNode* Variable::virtualChild(size_t n,
+        TempNode* tmp) const
+{
+    return elementNode(1, n * stride(1), tmp);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -116,6 +302,43 @@ void Variable::addCompoundFields(XmlElement &element,
 /////////////////////////////////////////////////////////////////////////////
 void Variable::setAttributes(
         XmlElement &element, bool shortReply) const
+{
+    std::string *attributes = attributeCache[shortReply];
+
+    if (!attributes) {
+        // Format the attributes of an element without name into a
+        // private stream and keep what follows the '<'
+        std::stringbuf buf;
+        XmlStream os(&buf);
+        {
+            XmlElement tmp("", os, 0, 0);
+            os.flush();
+            buf.str(std::string());
+
+            formatAttributes(tmp, shortReply);
+            os.flush();
+            attributes = new std::string(buf.str());
+        }
+
+        // Sessions may race here. The loser uses the winner's copy
+        if (!__sync_bool_compare_and_swap(
+                    &attributeCache[shortReply], 0, attributes)) {
+            delete attributes;
+            attributes = attributeCache[shortReply];
+        }
+    }
+
+    element.appendAttributes(*attributes);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Variable::setStaticAttributes(XmlElement &) const
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Variable::formatAttributes(
+        XmlElement &element, bool shortReply) const
 {
     // index=
     XmlElement::Attribute(element, "index") << index;
@@ -146,4 +369,6 @@ void Variable::setAttributes(
 
     // hide=
     // unhide=
+
+    setStaticAttributes(element);
 }
@@ -27,6 +27,10 @@
 #include "../Variable.h"
 #include "DirectoryNode.h"
 
+#include <map>
+#include <vector>
+#include <algorithm>
+
 namespace PdServ {
     class Variable;
 }
@@ -40,6 +44,7 @@ class Variable: public DirectoryNode {
         Variable(const PdServ::Variable *v, size_t index,
                 const PdServ::DataType& dtype,
                 const PdServ::DataType::DimType& dim, size_t offset);
+        ~Variable();
 
         const PdServ::Variable * const variable;
 
@@ -50,16 +55,143 @@ class Variable: public DirectoryNode {
         const size_t memSize;
         bool hidden;
 
+        // Split the variable into its elements. They are children of the
+        // variable and have the indices following index, but are only
+        // created when they are used
+        void split();
+        size_t elementCount() const;
+
+        // Element n, created on first use and kept. With tmp, an element
+        // that does not exist yet is created in tmp for the caller only
+        const Variable* element(size_t n,
+                TempNode* tmp = 0) const;
+
+        // Set the attributes that do not change. They are formatted
+        // once on first use and shared by all sessions
         void setAttributes(XmlElement &element,
                 bool shortReply) const;
         void addCompoundFields(XmlElement &element,
                 const PdServ::DataType& ) const;
 
+    protected:
+        // View of element n of a split variable
+        Variable(const Variable* parent, size_t n);
+
+        // Reimplement to add static attributes of the long reply
+        virtual void setStaticAttributes(XmlElement &element) const;
+
+        // Reimplement to create the view of element n
+        virtual Variable* createElement(size_t n) const = 0;
+
     private:
+        mutable std::string * volatile attributeCache[2];
+
+        // Directory of the elements of a row
+        class ElementDir;
+
+        // Elements and the directories of their rows by depth and first
+        // element, 0 unless the variable is split
+        typedef std::map<std::pair<size_t, size_t>, DirectoryNode*>
+            ElementMap;
+        ElementMap* elementMap;
+
+        std::string elementName;        // Name of an element view
+
+        size_t stride(size_t depth) const;
+        const DirectoryNode* elementNode(size_t depth, size_t start,
+                TempNode* tmp) const;
+
+        // Reimplemented from DirectoryNode
+        size_t virtualChildCount() const;
+        const DirectoryNode* virtualChild(size_t n,
+                TempNode* tmp) const;
+
+        void formatAttributes(XmlElement &element, bool shortReply) const;
         void setDataType(XmlElement &element, const PdServ::DataType& dtype,
                 const PdServ::DataType::DimType& dim) const;
 };
 
+/////////////////////////////////////////////////////////////////////////////
+// Channels or parameters by index. The elements of split variables follow
+// their variable and are created when they are used
+template <class T>
+class VariableTable {
+    public:
+        VariableTable(): count(0) {}
+
+        // The index of variable must be size()
+        void push_back(const T* variable);
+        void reserve(size_t variables) { list.reserve(variables); }
+        size_t size() const { return count; }
+
+        // Variable at index. Elements are created on first use and kept
+        const T* operator[](size_t index) const;
+
+        // Like operator[], but an element that does not exist yet is
+        // created in tmp for the caller only
+        const T* get(size_t index, TempNode& tmp) const;
+
+        // Variable at index, or the one the element at index belongs to
+        const T* variable(size_t index) const;
+
+        // The variables without their elements
+        const std::vector<const T*>& variables() const { return list; }
+
+    private:
+        std::vector<const T*> list;
+        size_t count;
+
+        static bool before(size_t index, const T* variable);
+};
+
+/////////////////////////////////////////////////////////////////////////////
+template <class T>
+void VariableTable<T>::push_back(const T* variable)
+{
+    list.push_back(variable);
+    count += 1 + variable->elementCount();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+template <class T>
+bool VariableTable<T>::before(size_t index, const T* variable)
+{
+    return index < variable->index;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+template <class T>
+const T* VariableTable<T>::variable(size_t index) const
+{
+    if (index >= count)
+        return 0;
+
+    return *--std::upper_bound(list.begin(), list.end(), index, before);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+template <class T>
+const T* VariableTable<T>::operator[](size_t index) const
+{
+    const T* v = variable(index);
+
+    return !v or v->index == index
+        ? v
+        : static_cast<const T*>(v->element(index - v->index - 1));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+template <class T>
+const T* VariableTable<T>::get(size_t index,
+        TempNode& tmp) const
+{
+    const T* v = variable(index);
+
+    return !v or v->index == index
+        ? v
+        : static_cast<const T*>(v->element(index - v->index - 1, &tmp));
+}
+
 }
 
 #endif //MSRVARIABLE_H
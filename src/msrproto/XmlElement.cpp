@@ -25,36 +25,50 @@
 #include "Variable.h"
 #include "../Debug.h"
 
-#include <sstream>
-#include <iomanip>
 #include <algorithm>
-#include <cstring>      // strpbrk()
+#include <cstring>      // strlen()
 
 using namespace MsrProto;
 
 /////////////////////////////////////////////////////////////////////////////
 // XmlElement
 /////////////////////////////////////////////////////////////////////////////
-XmlElement::XmlElement(const char *name, std::ostream &os,
+XmlElement::XmlElement(const char *name, XmlStream &os,
         size_t level, std::string *id):
     level(level), id(id), os(os), name(name)
 {
-    this->os << std::string(level,' ') << '<' << name;
+    if (!os.compact)
+        os.append(' ', level);
+    os.append('<');
+    os.append(name);
     printed = false;
 }
 
 /////////////////////////////////////////////////////////////////////////////
 XmlElement::~XmlElement()
 {
-    if (printed)
-        os << std::string(level, ' ') << "</" << name;
+    if (printed) {
+        if (!os.compact)
+            os.append(' ', level);
+        os.append("</", 2);
+        os.append(name);
+    }
     else {
         if (id and !id->empty())
             Attribute(*this,"id").setEscaped(*id);
-        os << '/';
+        os.append('/');
     }
 
-    os << ">\r\n";
+    endLine();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void XmlElement::endLine() const
+{
+    if (os.compact)
+        os.append('>');
+    else
+        os.append(">\r\n", 3);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -64,7 +78,7 @@ XmlElement XmlElement::createChild(const char* name)
         if (id and !id->empty())
             Attribute(*this,"id").setEscaped(*id);
 
-        os << ">\r\n";
+        endLine();
     }
 
     printed = 1;
@@ -72,79 +86,170 @@ XmlElement XmlElement::createChild(const char* name)
     return XmlElement(name, os, level+1, 0);
 }
 
+/////////////////////////////////////////////////////////////////////////////
+void XmlElement::appendAttributes(const std::string& attributes)
+{
+    os.append(attributes.data(), attributes.size());
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // XmlElement::Attribute
 /////////////////////////////////////////////////////////////////////////////
 XmlElement::Attribute::Attribute(XmlElement& el, const char *name):
     os(el.os)
 {
-    os << ' ' << name << "=\"";
+    size_t len = ::strlen(name);
+    char* p = os.reserve(len + 3);
+
+    *p++ = ' ';
+    p = std::copy(name, name + len, p);
+    *p++ = '=';
+    *p++ = '"';
+
+    os.commit(p);
 }
 
 /////////////////////////////////////////////////////////////////////////////
 XmlElement::Attribute::~Attribute()
 {
-    os << '"';
+    os.append('"');
+}
+
+/////////////////////////////////////////////////////////////////////////////
+XmlElement::Attribute& XmlElement::Attribute::operator<<(const char *s)
+{
+    os.append(s);
+    return *this;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+XmlElement::Attribute& XmlElement::Attribute::operator<<(const std::string& s)
+{
+    os.append(s.data(), s.size());
+    return *this;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+XmlElement::Attribute& XmlElement::Attribute::operator<<(char c)
+{
+    os.append(c);
+    return *this;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+XmlElement::Attribute& XmlElement::Attribute::operator<<(bool b)
+{
+    os.append(b ? '1' : '0');
+    return *this;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+XmlElement::Attribute& XmlElement::Attribute::operator<<(int i)
+{
+    os.appendSigned(i);
+    return *this;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+XmlElement::Attribute& XmlElement::Attribute::operator<<(unsigned int i)
+{
+    os.appendUnsigned(i);
+    return *this;
 }
 
 /////////////////////////////////////////////////////////////////////////////
-std::ostream& XmlElement::Attribute::operator<<(const char *s)
+XmlElement::Attribute& XmlElement::Attribute::operator<<(long i)
 {
-    os << s;
-    return os;
+    os.appendSigned(i);
+    return *this;
 }
 
 /////////////////////////////////////////////////////////////////////////////
-std::ostream& XmlElement::Attribute::operator <<( struct timespec const& ts)
+XmlElement::Attribute& XmlElement::Attribute::operator<<(unsigned long i)
 {
-    std::ostringstream time;
-    time << ts.tv_sec << '.'
-        << std::setfill('0') << std::setw(6) << ts.tv_nsec / 1000;
+    os.appendUnsigned(i);
+    return *this;
+}
 
-    os << time.str();
-    return os;
+/////////////////////////////////////////////////////////////////////////////
+XmlElement::Attribute& XmlElement::Attribute::operator<<(long long i)
+{
+    os.appendSigned(i);
+    return *this;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+XmlElement::Attribute& XmlElement::Attribute::operator<<(unsigned long long i)
+{
+    os.appendUnsigned(i);
+    return *this;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+XmlElement::Attribute& XmlElement::Attribute::operator<<(double d)
+{
+    // Floating point numbers still use the stream so that the output
+    // is not changed
+    os.stream() << d;
+    return *this;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+XmlElement::Attribute& XmlElement::Attribute::operator<<(
+        struct timespec const& ts)
+{
+    os.appendTime(ts);
+    return *this;
 }
 
 /////////////////////////////////////////////////////////////////////////////
 void XmlElement::Attribute::setEscaped( const std::string& str)
 {
-    const char *escape = "<>&\"'";
-    size_t start = 0, pos;
+    setEscaped(str.data(), str.size());
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void XmlElement::Attribute::setEscaped( const char *str, size_t len)
+{
+    const char *end = str + len;
+    const char *pos;
 
-    while (std::string::npos != (pos = str.find_first_of(escape, start))) {
-        os << str.substr(start, pos - start);
-        switch (str[pos]) {
+    while ((pos = std::find_first_of(str, end, "<>&\"'", "<>&\"'" + 5))
+            != end) {
+        os.append(str, pos - str);
+        switch (*pos) {
             case '<':
-                os << "&lt;";
+                os.append("&lt;", 4);
                 break;
 
             case '>':
-                os << "&gt;";
+                os.append("&gt;", 4);
                 break;
 
             case '&':
-                os << "&amp;";
+                os.append("&amp;", 5);
                 break;
 
             case '"':
-                os << "&quot;";
+                os.append("&quot;", 6);
                 break;
 
             case '\'':
-                os << "&apos;";
+                os.append("&apos;", 6);
                 break;
         }
 
-        start = pos + 1;
+        str = pos + 1;
     }
 
-    os << str.substr(start);
+    os.append(str, end - str);
 }
 
 /////////////////////////////////////////////////////////////////////////////
 void XmlElement::Attribute::csv(const Variable* var, const char *buf,
         size_t nblocks, std::streamsize precision)
 {
+    std::ostream& os = this->os.stream();
     char delim = '\0';
 
     // Save current and set new precision
@@ -162,39 +267,60 @@ void XmlElement::Attribute::csv(const Variable* var, const char *buf,
     os.precision(precision);
 }
 
+/////////////////////////////////////////////////////////////////////////////
+void XmlElement::Attribute::csv(const PdServ::DataType& dtype,
+        const char *buf, size_t nelem, std::streamsize precision)
+{
+    std::ostream& os = this->os.stream();
+
+    precision = os.precision(precision);
+    dtype.print(os, buf, buf, buf + nelem * dtype.size);
+    os.precision(precision);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 void XmlElement::Attribute::base64( const void *data, size_t len) const
 {
      static const char *base64Chr = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
          "abcdefghijklmnopqrstuvwxyz0123456789+/";
-     size_t i = 0;
-     size_t rem = len % 3;
+     static const size_t chunk = 3 * 1024;
      const unsigned char *buf = reinterpret_cast<const unsigned char*>(data);
 
-     // First convert all characters in chunks of 3
-     while (i != len - rem) {
-         os <<  base64Chr[  buf[i  ]         >> 2]
-             << base64Chr[((buf[i  ] & 0x03) << 4) + (buf[i+1] >> 4)]
-             << base64Chr[((buf[i+1] & 0x0f) << 2) + (buf[i+2] >> 6)]
-             << base64Chr[ (buf[i+2] & 0x3f)     ];
-
-         i += 3;
+     // First convert all characters in chunks of 3, at most 4k output
+     // characters at a time
+     while (len >= 3) {
+         size_t n = std::min(len - len % 3, chunk);
+         const unsigned char *end = buf + n;
+         char *p = os.reserve(n / 3 * 4);
+
+         for (; buf != end; buf += 3) {
+             *p++ = base64Chr[  buf[0]         >> 2];
+             *p++ = base64Chr[((buf[0] & 0x03) << 4) + (buf[1] >> 4)];
+             *p++ = base64Chr[((buf[1] & 0x0f) << 2) + (buf[2] >> 6)];
+             *p++ = base64Chr[ (buf[2] & 0x3f)     ];
+         }
+
+         os.commit(p);
+         len -= n;
      }
 
      // Convert the remaining 1 or 2 characters
-     switch (rem) {
+     char *p = os.reserve(4);
+     switch (len) {
          case 2:
-             os <<  base64Chr[  buf[i  ]         >> 2]
-                 << base64Chr[((buf[i  ] & 0x03) << 4) + (buf[i+1] >> 4)]
-                 << base64Chr[ (buf[i+1] & 0x0f) << 2]
-                 << '=';
+             *p++ = base64Chr[  buf[0]         >> 2];
+             *p++ = base64Chr[((buf[0] & 0x03) << 4) + (buf[1] >> 4)];
+             *p++ = base64Chr[ (buf[1] & 0x0f) << 2];
+             *p++ = '=';
              break;
          case 1:
-             os <<  base64Chr[  buf[i]         >> 2]
-                 << base64Chr[ (buf[i] & 0x03) << 4]
-                 << "==";
+             *p++ = base64Chr[  buf[0]         >> 2];
+             *p++ = base64Chr[ (buf[0] & 0x03) << 4];
+             *p++ = '=';
+             *p++ = '=';
              break;
      }
+     os.commit(p);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -202,7 +328,7 @@ void XmlElement::Attribute::hexDec( const void *data, size_t len) const
 {
      const unsigned char *buf =
          reinterpret_cast<const unsigned char*>(data);
-     const char *hexValue[256] = {
+     static const char *hexValue[256] = {
          "00", "01", "02", "03", "04", "05", "06", "07", "08", "09",
          "0A", "0B", "0C", "0D", "0E", "0F", "10", "11", "12", "13",
          "14", "15", "16", "17", "18", "19", "1A", "1B", "1C", "1D",
@@ -230,6 +356,19 @@ void XmlElement::Attribute::hexDec( const void *data, size_t len) const
          "F0", "F1", "F2", "F3", "F4", "F5", "F6", "F7", "F8", "F9",
          "FA", "FB", "FC", "FD", "FE", "FF"};
 
-     while (len--)
-         os << hexValue[*buf++];
+     static const size_t chunk = 2048;
+
+     while (len) {
+         size_t n = std::min(len, chunk);
+         char *p = os.reserve(2 * n);
+
+         for (size_t i = 0; i < n; ++i) {
+             const char *hex = hexValue[*buf++];
+             *p++ = hex[0];
+             *p++ = hex[1];
+         }
+
+         os.commit(p);
+         len -= n;
+     }
 }
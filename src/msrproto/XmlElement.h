@@ -27,19 +27,26 @@
 #ifndef XMLDOC_H
 #define XMLDOC_H
 
-#include <ostream>
+#include <ios>
 #include <string>
 
+#include "XmlStream.h"
+
+namespace PdServ {
+    class DataType;
+}
+
 namespace MsrProto {
 
 class Variable;
 
 class XmlElement {
     public:
-        XmlElement(const char *name, std::ostream &os,
+        XmlElement(const char *name, XmlStream &os,
                 size_t level, std::string *id);
         XmlElement(const XmlElement& other):
-            level(other.level), id(other.id), os(other.os), name(other.name) {
+            level(other.level), id(other.id), os(other.os),
+            name(other.name), printed(other.printed) {
             }
 
         /** Destructor.
@@ -48,6 +55,10 @@ class XmlElement {
 
         XmlElement createChild(const char *name);
 
+        /** Append preformatted attributes, e.g. from a cache. Only valid
+         * before children are created */
+        void appendAttributes(const std::string& attributes);
+
         const size_t level;
         std::string* const id;
 
@@ -59,38 +70,43 @@ class XmlElement {
                 /** Set string attribute, checking for characters
                  * that need to be escaped */
                 void setEscaped( const std::string& value);
+                void setEscaped( const char *value, size_t len);
 
                 void csv(const Variable* var, const char *buf,
                         size_t nblocks, std::streamsize precision);
+                void csv(const PdServ::DataType& dtype, const char *buf,
+                        size_t nelem, std::streamsize precision);
                 void base64( const void *data, size_t len) const;
                 void hexDec( const void *data, size_t len) const;
 
-
-                std::ostream& operator<<(const struct timespec &t);
+                Attribute& operator<<(const struct timespec &t);
 
                 /** Various variations of numerical attributes */
-                std::ostream& operator<<(const char *s);
-                template <typename T>
-                    std::ostream& operator<<(T const& val);
+                Attribute& operator<<(const char *s);
+                Attribute& operator<<(const std::string& s);
+                Attribute& operator<<(char c);
+                Attribute& operator<<(bool b);
+                Attribute& operator<<(int i);
+                Attribute& operator<<(unsigned int i);
+                Attribute& operator<<(long i);
+                Attribute& operator<<(unsigned long i);
+                Attribute& operator<<(long long i);
+                Attribute& operator<<(unsigned long long i);
+                Attribute& operator<<(double d);
 
             private:
-                std::ostream& os;
+                XmlStream& os;
 
         };
 
     private:
-        std::ostream& os;
+        XmlStream& os;
 
         const char * const name;
         bool printed;
-};
 
-    template <typename T>
-std::ostream& XmlElement::Attribute::operator<<(T const& val)
-{
-    os << val;
-    return os;
-}
+        void endLine() const;
+};
 
 }
 
@@ -33,15 +33,66 @@
 
 using namespace MsrProto;
 
+/////////////////////////////////////////////////////////////////////////////
+// Character classes used while scanning. A table lookup is cheaper than
+// strchr() for every character
+namespace {
+    enum {
+        NameEnd      = 1,       // " />" and '\0'
+        ArgumentEnd  = 2,       // "= />" and '\0'
+        ValueEnd     = 4        // " >"
+    };
+
+    struct CharClass {
+        CharClass() {
+            std::fill(table, table + 256, 0);
+
+            table[0]                   = NameEnd | ArgumentEnd;
+            table[uint8_t(' ')]        = NameEnd | ArgumentEnd | ValueEnd;
+            table[uint8_t('/')]        = NameEnd | ArgumentEnd;
+            table[uint8_t('>')]        = NameEnd | ArgumentEnd | ValueEnd;
+            table[uint8_t('=')]        = ArgumentEnd;
+        }
+
+        bool is(char c, int cls) const {
+            return table[uint8_t(c)] & cls;
+        }
+
+        uint8_t table[256];
+    };
+
+    const CharClass charClass;
+
+    // Find c in [begin, end), returning end if it is not found. memchr()
+    // is vectorized in every decent C library
+    char* find(char* begin, char* end, char c)
+    {
+        void *p = ::memchr(begin, c, end - begin);
+        return p ? static_cast<char*>(p) : end;
+    }
+}
+
+const size_t XmlParser::bufIncrement;
+
 /////////////////////////////////////////////////////////////////////////////
 XmlParser::XmlParser(size_t bufMax): bufLenMax(bufMax)
 {
+    attribute.reserve(16);
+
     parseState = FindElementStart;
     buf = 0;
     bufEnd = 0;
     inputEnd = 0;
     parsePos = 0;
     name = 0;
+    valueStream = 0;
+    value = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void XmlParser::setValueStream(ValueStream* stream)
+{
+    valueStream = stream;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -66,7 +117,12 @@ std::streamsize XmlParser::read(std::streambuf* sb)
         }
         else {
             log_debug("allocate new buffer");
-            size_t bufLen = (bufEnd - buf) + bufIncrement;
+
+            // Grow geometrically, so that large elements do not cause
+            // quadratic copying
+            size_t bufLen = std::min(
+                    std::max(2 * size_t(bufEnd - buf), bufIncrement),
+                    bufLenMax);
             char *newBuf = new char[bufLen];
 
             moveData(newBuf);
@@ -102,6 +158,8 @@ void XmlParser::moveData(char* dst)
     inputEnd += diff;
     name     += diff;
     argument += diff;
+    if (value)
+        value += diff;
 
     for (AttributeList::iterator it = attribute.begin();
             it != attribute.end(); ++it) {
@@ -129,7 +187,7 @@ XmlParser::operator bool()
                 // At the end of this state, name set up correctly
                 // and there is at least one valid character following name
 
-                parsePos = std::find(parsePos, inputEnd, '<');
+                parsePos = ::find(parsePos, inputEnd, '<');
 
                 if (parsePos + 2 >= inputEnd) {
                     // Smallest element needs at least 2 more characters,
@@ -147,6 +205,9 @@ XmlParser::operator bool()
                 attribute.clear();
                 starttls = false;
 
+                if (valueStream)
+                    valueStream->startElement();
+
                 parseState = FindElementEnd;
 
                 // no break
@@ -197,7 +258,7 @@ XmlParser::operator bool()
             case FindArgumentName:
                 // In this state, the argument name is searched for. It is
                 // terminated by a '=', ' ', '/' or '>'
-                while (!strchr("= />", *parsePos))
+                while (!charClass.is(*parsePos, ArgumentEnd))
                     if (++parsePos == inputEnd)
                         return false;
 
@@ -238,20 +299,41 @@ XmlParser::operator bool()
                 parsePos += 2;
                 parseState = FindQuotedArgumentValue;
 
+                value = 0;
+                if (valueStream and valueStream->openValue(this, argument))
+                    value = parsePos;
+
                 // no break
 
             case FindQuotedArgumentValue:
-                parsePos = std::find(parsePos, inputEnd, quote);
+                parsePos = ::find(parsePos, inputEnd, quote);
+
+                if (value) {
+                    // Pass on the value received so far and discard it,
+                    // so that the buffer does not need to hold the value
+                    valueStream->writeValue(value, parsePos - value);
+
+                    if (parsePos == inputEnd) {
+                        parsePos = inputEnd = value;
+                        return false;
+                    }
+
+                    // Closing quote found. The attribute becomes empty
+                    attribute.back().second = parsePos;
+                    value = parsePos;
+                }
+
                 if (parsePos + 1 >= inputEnd)
                     return false;
 
                 *parsePos++ = '\0';
+                value = 0;
                 parseState = FindElementEnd;
 
                 // no break
 
             case FindArgumentValue:
-                while (*parsePos != ' ' and *parsePos != '>') {
+                while (!charClass.is(*parsePos, ValueEnd)) {
                     if (++parsePos == inputEnd)
                         return false;
                 }
@@ -264,7 +346,7 @@ XmlParser::operator bool()
                 // closing \0 and starttls is tested for
 
                 // Name is any set of characters not in " />"
-                while (!strchr(" />", *parsePos)) {
+                while (!charClass.is(*parsePos, NameEnd)) {
                     if (++parsePos == inputEnd)
                         return false;
                 }
@@ -416,6 +498,21 @@ bool XmlParser::getUnsigned(const char *name, unsigned int &i) const
     return true;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+bool XmlParser::getDouble(const char *name, double &d) const
+{
+    const char *value;
+
+    if (!(find(name, &value)) or !value)
+        return false;
+
+    std::istringstream is(value);
+    is.imbue(std::locale::classic());
+
+    is >> d;
+    return !is.fail();
+}
+
 /////////////////////////////////////////////////////////////////////////////
 bool XmlParser::getUnsignedList(const char *name,
         std::list<unsigned int> &intList) const
@@ -27,6 +27,7 @@
 #include <stdint.h>
 #include <cstddef>
 #include <list>
+#include <vector>
 #include <string>
 #include <unistd.h>
 
@@ -34,11 +35,31 @@ namespace MsrProto {
 
 class XmlParser {
     public:
+        // Receiver of attribute values that are passed on in pieces
+        // while they arrive instead of being kept in the buffer
+        struct ValueStream {
+            virtual ~ValueStream() {}
+
+            // Called when a new element starts. Values received before
+            // belong to an element that is complete or was dropped
+            virtual void startElement() = 0;
+
+            // Called when the quoted value of attribute starts. The
+            // attributes before it are available, the value of attribute
+            // itself is not terminated yet and must not be read. Return
+            // true to receive the value with writeValue(). The attribute
+            // is then empty
+            virtual bool openValue(const XmlParser* parser,
+                    const char* attribute) = 0;
+            virtual void writeValue(const char* s, size_t n) = 0;
+        };
+
         XmlParser(size_t max = bufIncrement * 1000);
         XmlParser(const char *begin, const char *end);
         ~XmlParser();
 
         std::streamsize read(std::streambuf*);
+        void setValueStream(ValueStream* stream);
         operator bool();
         bool invalid() const;
 
@@ -48,16 +69,22 @@ class XmlParser {
         bool isTrue(const char *name) const;
         bool getString(const char *name, std::string &s) const;
         bool getUnsigned(const char *name, unsigned int &i) const;
+        bool getDouble(const char *name, double &d) const;
         bool getUnsignedList(const char *name,
                 std::list<unsigned int> &i) const;
 
     private:
         const size_t bufLenMax;
 
+        // Attributes of the current element. The vector is only cleared
+        // between elements, so that it does not allocate memory once it
+        // has grown to the usual number of attributes
         typedef std::pair<const char*, const char*> Attribute;
-        typedef std::list<Attribute> AttributeList;
+        typedef std::vector<Attribute> AttributeList;
         AttributeList attribute;
 
+        // Initial buffer size. The buffer is doubled when an element
+        // does not fit, up to bufLenMax
         static const size_t bufIncrement = 1024;
         const char* bufEnd;
         char* buf;
@@ -71,6 +98,9 @@ class XmlParser {
 
         char quote;
 
+        ValueStream* valueStream;
+        char* value;           // Start of a value passed to valueStream
+
         enum ParseState {
             FindElementStart, FindNameEnd,
             FindArgumentName, FindQuotedArgumentValue, FindArgumentValue,
@@ -0,0 +1,209 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "XmlStream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <locale>
+
+using namespace MsrProto;
+
+/////////////////////////////////////////////////////////////////////////////
+XmlStream::XmlStream(std::streambuf* sink, size_t bufsize):
+    compact(false), sink(sink), os(this), p_good(true)
+{
+    char* buf = new char[bufsize];
+    setp(buf, buf + bufsize);
+
+    os.imbue(std::locale::classic());
+}
+
+/////////////////////////////////////////////////////////////////////////////
+XmlStream::~XmlStream()
+{
+    delete[] pbase();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool XmlStream::good() const
+{
+    return p_good and os.good();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+std::ostream& XmlStream::stream()
+{
+    return os;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool XmlStream::flush()
+{
+    drain();
+
+    if (p_good and sink->pubsync() == -1)
+        p_good = false;
+
+    return p_good;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void XmlStream::drain()
+{
+    std::streamsize count = pptr() - pbase();
+
+    if (count and p_good and sink->sputn(pbase(), count) != count)
+        p_good = false;
+
+    // Reset put pointer. Data is discarded silently when the sink is
+    // not good any more
+    setp(pbase(), epptr());
+}
+
+/////////////////////////////////////////////////////////////////////////////
+char* XmlStream::grow(size_t n)
+{
+    drain();
+
+    size_t size = epptr() - pbase();
+    if (n > size) {
+        // Requested more than the buffer can hold. Since the buffer
+        // is empty after drain(), it can simply be replaced
+        size = std::max(2*size, n);
+
+        delete[] pbase();
+        char* buf = new char[size];
+        setp(buf, buf + size);
+    }
+
+    return pptr();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void XmlStream::append(const char* s, size_t n)
+{
+    while (n) {
+        if (pptr() == epptr())
+            drain();
+
+        size_t len = std::min(n, size_t(epptr() - pptr()));
+        std::copy(s, s + len, pptr());
+        pbump(len);
+
+        s += len;
+        n -= len;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void XmlStream::append(const char* s)
+{
+    append(s, ::strlen(s));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void XmlStream::append(char c, size_t count)
+{
+    while (count) {
+        if (pptr() == epptr())
+            drain();
+
+        size_t len = std::min(count, size_t(epptr() - pptr()));
+        std::fill_n(pptr(), len, c);
+        pbump(len);
+
+        count -= len;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void XmlStream::appendUnsigned(unsigned long long value)
+{
+    char buf[20];       // 2^64 has 20 decimal digits
+    char* p = buf + sizeof(buf);
+
+    do {
+        *--p = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    append(p, buf + sizeof(buf) - p);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void XmlStream::appendSigned(long long value)
+{
+    if (value < 0) {
+        append('-');
+
+        // Negate as unsigned so that the smallest value works too
+        appendUnsigned(0ULL - static_cast<unsigned long long>(value));
+    }
+    else
+        appendUnsigned(value);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Time format: <sec>.<usec>, usec always having 6 digits
+void XmlStream::appendTime(const struct timespec& ts)
+{
+    appendSigned(ts.tv_sec);
+
+    unsigned long usec = ts.tv_nsec / 1000;
+    char* p = reserve(7);
+
+    *p = '.';
+    for (int i = 6; i; --i) {
+        p[i] = '0' + usec % 10;
+        usec /= 10;
+    }
+
+    commit(p + 7);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+int XmlStream::overflow(int c)
+{
+    drain();
+
+    if (c != traits_type::eof()) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+
+    return p_good ? traits_type::not_eof(c) : traits_type::eof();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+std::streamsize XmlStream::xsputn(const char* s, std::streamsize n)
+{
+    append(s, n);
+    return n;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+int XmlStream::sync()
+{
+    return flush() ? 0 : -1;
+}
@@ -0,0 +1,100 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef MSRXMLSTREAM_H
+#define MSRXMLSTREAM_H
+
+#include <streambuf>
+#include <ostream>
+#include <cstddef>
+#include <ctime>
+
+namespace MsrProto {
+
+/* Output buffer used by XmlElement.
+ *
+ * Data is written directly into a preallocated byte buffer using
+ * reserve()/commit() or the various append() methods. When the buffer is
+ * full, or when flush() is called, its contents are passed on to the
+ * sink in a single sputn() call.
+ *
+ * XmlStream is a std::streambuf itself, so that formatting that still
+ * requires a std::ostream (e.g. DataType::print()) can use stream()
+ * and lands in the same buffer.
+ */
+class XmlStream: public std::streambuf {
+    public:
+        XmlStream(std::streambuf* sink, size_t bufsize = 16384);
+        ~XmlStream();
+
+        // When compact is set, XmlElement omits indentation and line ends
+        bool compact;
+
+        bool good() const;
+
+        // Pass buffered data to the sink and synchronize it
+        bool flush();
+
+        // Make sure that at least n bytes are available, returning the
+        // current write pointer. Write at most n bytes and finish with
+        // commit()
+        char* reserve(size_t n) {
+            return size_t(epptr() - pptr()) >= n ? pptr() : grow(n);
+        }
+        void commit(char* p) {
+            pbump(p - pptr());
+        }
+
+        void append(char c) {
+            *reserve(1) = c;
+            pbump(1);
+        }
+        void append(const char* s, size_t n);
+        void append(const char* s);
+        void append(char c, size_t count);
+
+        void appendUnsigned(unsigned long long value);
+        void appendSigned(long long value);
+        void appendTime(const struct timespec& ts);
+
+        // Stream used for formatting that is not implemented natively.
+        // It uses the classic locale.
+        std::ostream& stream();
+
+    private:
+        std::streambuf* const sink;
+        std::ostream os;
+        bool p_good;
+
+        char* grow(size_t n);
+        void drain();
+
+        // Reimplemented from std::streambuf
+        int overflow(int c);
+        std::streamsize xsputn(const char* s, std::streamsize n);
+        int sync();
+};
+
+}
+
+#endif // MSRXMLSTREAM_H
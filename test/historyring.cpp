@@ -0,0 +1,115 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "HistoryRing.h"
+
+#include <cmath>
+#include <cstring>
+#include <assert.h>
+
+#include <iostream>
+using std::cout;
+using std::endl;
+
+using namespace MsrProto;
+
+int main()
+{
+    const uint64_t period = 1000000;    // 1ms
+    const size_t samples = 100000;
+
+    // Doubles with a slightly jittering sample time
+    {
+        HistoryRing ring(64 * 1024, sizeof(double));
+        std::vector<uint64_t> t0;
+        std::vector<double> v0;
+
+        for (size_t i = 0; i < samples; ++i) {
+            uint64_t t = 1000000000ULL + i * period + (i % 7) * 1000;
+            double v = std::floor(1000 * std::sin(i * 0.001)) / 1000;
+
+            ring.append(t, reinterpret_cast<const char*>(&v));
+            t0.push_back(t);
+            v0.push_back(v);
+        }
+
+        std::vector<uint64_t> time;
+        std::vector<char> value;
+        size_t n = ring.read(0, 1, time, value);
+
+        assert(n == time.size());
+        assert(value.size() == n * sizeof(double));
+
+        // Ring wrapped around, but holds a contiguous tail
+        assert(n > 1000 and n < samples);
+        for (size_t i = 0; i < n; ++i) {
+            size_t j = samples - n + i;
+            double v;
+            std::memcpy(&v, &value[i * sizeof(double)], sizeof(v));
+            assert(time[i] == t0[j]);
+            assert(v == v0[j]);
+        }
+
+        cout << n << " samples in 64kB, "
+            << 64.0 * 1024 * 8 / n << " bits per sample" << endl;
+
+        // Only the last second, every 10th sample
+        time.clear();
+        value.clear();
+        n = ring.read(t0.back() - 1000000000ULL, 10, time, value);
+        assert(n == 100 or n == 101);
+        assert(time.front() >= t0.back() - 1000000000ULL);
+        assert(time[1] - time[0] >= 10 * period - 7000);
+    }
+
+    // Small integers with irregular time
+    {
+        HistoryRing ring(1024 * 1024, sizeof(int16_t));
+
+        for (int16_t i = 0; i < 1000; ++i) {
+            int16_t v = -i * 3;
+            ring.append(uint64_t(i) * i * 12345, reinterpret_cast<char*>(&v));
+        }
+
+        std::vector<uint64_t> time;
+        std::vector<char> value;
+        assert(ring.read(0, 1, time, value) == 1000);
+
+        for (int16_t i = 0; i < 1000; ++i) {
+            int16_t v;
+            std::memcpy(&v, &value[i * sizeof(v)], sizeof(v));
+            assert(time[i] == uint64_t(i) * i * 12345);
+            assert(v == -i * 3);
+        }
+    }
+
+    // Empty ring
+    {
+        HistoryRing ring(0, sizeof(double));
+        std::vector<uint64_t> time;
+        std::vector<char> value;
+        assert(ring.read(0, 1, time, value) == 0);
+    }
+
+    return 0;
+}
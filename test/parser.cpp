@@ -53,6 +53,32 @@ struct stringstream: std::iostream {
     std::streamsize chunk;
 };
 
+struct valuestream: XmlParser::ValueStream {
+    void startElement() {
+        ++elements;
+    }
+    bool openValue(const XmlParser* parser, const char* attribute) {
+        return !strcmp(parser->tag(), "wp") and !strcmp(attribute, "value");
+    }
+    void writeValue(const char* s, size_t n) {
+        value.append(s, n);
+    }
+    std::string value;
+    int elements;
+};
+
+// Like Session: looks at the name when the value starts
+struct namedvaluestream: valuestream {
+    bool openValue(const XmlParser* parser, const char* attribute) {
+        ++opened;
+        if (strcmp(attribute, "value"))
+            return false;
+        return parser->getString("name", name);
+    }
+    std::string name;
+    int opened;
+};
+
 int main(int , const char *[])
 {
     stringstream buffer;
@@ -247,6 +273,10 @@ int main(int , const char *[])
     assert( inbuf.isTrue("truestr"));
     assert(!inbuf.isTrue("falsestr"));
     assert( inbuf.isTrue("onstr"));
+    double d;
+    assert( inbuf.getDouble("trueval", d) and d == 1.0);
+    assert(!inbuf.getDouble("with", d));
+    assert(!inbuf.getDouble("unknown", d));
     assert(inbuf.find("and", &s));
     assert(!strcmp(s, "quoted /> > &quot; &apos;"));
     std::string str;
@@ -303,5 +333,55 @@ int main(int , const char *[])
     assert(!strcmp(s, "/path/to/v/"));
     assert(!inbuf);
 
+    // Values passed on while they are received
+    valuestream vs;
+    vs.elements = 0;
+    XmlParser streamParser(64);
+    streamParser.setValueStream(&vs);
+
+    std::string longValue;
+    for (int i = 0; i < 1000; ++i)
+        longValue.append("1.5,");
+    buffer << "<wp index=\"7\" value=\"" << longValue << "\" hex/>"
+        << "<rp value=\"1\"/>";
+    do {
+        assert(buffer.rdbuf()->in_avail());
+        streamParser.read(buffer.rdbuf());
+    } while (!streamParser);
+    assert(!strcmp(streamParser.tag(), "wp"));
+    assert(vs.value == longValue);
+    assert(streamParser.find("value", &s) and !*s);
+    assert(streamParser.isTrue("hex"));
+    assert(streamParser.isEqual("index", "7"));
+    do {
+        assert(buffer.rdbuf()->in_avail());
+        streamParser.read(buffer.rdbuf());
+    } while (!streamParser);
+    assert(!strcmp(streamParser.tag(), "rp"));
+    assert(streamParser.isEqual("value", "1"));
+    assert(vs.value == longValue);
+    assert(vs.elements == 2);
+
+    // The name is complete when the value starts, even if it arrives
+    // in pieces
+    namedvaluestream nvs;
+    nvs.opened = 0;
+    nvs.elements = 0;
+    XmlParser nameParser(64);
+    nameParser.setValueStream(&nvs);
+
+    buffer.chunk = 3;
+    buffer << "<wp name=\"/a/rather/long/path/to/a/parameter\" "
+        "value=\"1,2,3\"/>";
+    do {
+        assert(buffer.rdbuf()->in_avail());
+        nameParser.read(buffer.rdbuf());
+    } while (!nameParser);
+    assert(!strcmp(nameParser.tag(), "wp"));
+    assert(nvs.opened == 2);
+    assert(nvs.name == "/a/rather/long/path/to/a/parameter");
+    assert(nvs.value == "1,2,3");
+    assert(nameParser.isEqual("name", "/a/rather/long/path/to/a/parameter"));
+
     return 0;
 }
@@ -0,0 +1,110 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+/* Throughput benchmark for XmlParser.
+ *
+ * A stream of typical client commands is fed to the parser in chunks
+ * as they would arrive from a socket. Every attribute is looked up
+ * once, as Session does.
+ */
+
+#include "XmlParser.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <iostream>
+#include <sys/time.h>
+
+using namespace MsrProto;
+
+struct chunkbuf: std::stringbuf {
+    chunkbuf(const std::string& s, std::streamsize chunk):
+        std::stringbuf(s), chunk(chunk) {}
+    std::streamsize xsgetn(char* s, std::streamsize n) {
+        return std::stringbuf::xsgetn(s, std::min(n, chunk));
+    }
+    const std::streamsize chunk;
+};
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+int main(int argc, const char *argv[])
+{
+    size_t count = argc > 1 ? strtoul(argv[1], 0, 0) : 200000;
+
+    static const char *commands[] = {
+        "<ping id=\"42\"/>\n",
+        "<rp index=\"134\" short/>\n",
+        "<xsad channels=\"1,2,3,4,5,6,7,8\" reduction=\"10\" blocksize=\"100\""
+            " coding=\"Base64\" group=\"1\" precision=\"12\"/>\n",
+        "<wp index=\"17\" value=\"1.5,2.5,3.5,4.5\" startindex=\"2\"/>\n",
+        "<read_parameter name=\"/path/to/some/parameter\" hex/>\n",
+        "<remote_host name=\"client\" applicationname=\"bench\""
+            " access=\"allow\"/>\n",
+    };
+    static const size_t n = sizeof(commands) / sizeof(*commands);
+
+    std::string input;
+    for (size_t i = 0; i < count; ++i)
+        input.append(commands[i % n]);
+
+    static const char *attributes[] = {
+        "id", "index", "short", "channels", "reduction", "blocksize",
+        "coding", "group", "precision", "value", "startindex", "name",
+        "hex", "applicationname", "access",
+    };
+    static const size_t na = sizeof(attributes) / sizeof(*attributes);
+
+    chunkbuf sb(input, 4096);
+    XmlParser parser(1 << 20);
+
+    size_t elements = 0, found = 0;
+    double t0 = now();
+    while (sb.in_avail()) {
+        parser.read(&sb);
+        while (parser) {
+            ++elements;
+            for (size_t i = 0; i < na; ++i)
+                found += parser.find(attributes[i]);
+        }
+    }
+    double t = now() - t0;
+
+    if (elements != count) {
+        std::cerr << "Parsed " << elements << " of " << count
+            << " elements" << std::endl;
+        return 1;
+    }
+
+    std::cout << elements << " elements, " << input.size() << " bytes, "
+        << found << " attributes in " << t << "s: "
+        << input.size() / t / 1e6 << " MB/s, "
+        << elements / t << " elements/s" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "PathIndex.h"
+
+#include <sstream>
+#include <vector>
+#include <assert.h>
+
+int main()
+{
+    PdServ::PathIndex<const int> index;
+    std::vector<int> value(5000);
+
+    assert(!index.find("/a"));
+
+    for (size_t i = 0; i < value.size(); ++i) {
+        std::ostringstream os;
+        os << "/model/block" << i / 10 << "/param" << i;
+        value[i] = i;
+        assert(index.insert(os.str(), &value[i]));
+    }
+    assert(index.size() == value.size());
+
+    // Duplicates keep the first entry
+    assert(!index.insert("/model/block0/param0", &value[1]));
+
+    for (size_t i = 0; i < value.size(); ++i) {
+        std::ostringstream os;
+        os << "/model/block" << i / 10 << "/param" << i;
+        assert(index.find(os.str()) == &value[i]);
+    }
+
+    assert(!index.find("/model/block0/param"));
+    assert(!index.find("/model/block0/param00"));
+    assert(!index.find(""));
+
+    assert(index.insert("", &value[0]));
+    assert(index.find("") == &value[0]);
+
+    // Keys are compared by length too
+    const char key[] = "/model/block0/param1x";
+    assert(index.find(key, sizeof(key) - 2) == &value[1]);
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+/* Startup benchmark.
+ *
+ * Registers a model with many signals and parameters, organized in a deep
+ * path hierarchy with the usual markup (<hide>, <persistent>) and some
+ * vectors and matrices. Then the time that pdserv_prepare() takes is
+ * measured, as well as the time until the MSR server accepts a connection
+ * and sends its greeting.
+ *
+ * Usage: startupbench [variables [config file [port]]]
+ */
+
+#include "pdserv.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <iostream>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static int gettime(struct timespec *t)
+{
+    return clock_gettime(CLOCK_REALTIME, t);
+}
+
+// Try to connect to the server and receive the first bytes of the
+// greeting
+static bool greeted(unsigned short port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    bool rv = false;
+    if (!::connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                sizeof(addr))) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        char buf[64];
+        rv = ::poll(&pfd, 1, 10) > 0 and ::read(fd, buf, sizeof(buf)) > 0;
+    }
+
+    ::close(fd);
+    return rv;
+}
+
+int main(int argc, const char *argv[])
+{
+    const size_t count = argc > 1 ? strtoul(argv[1], 0, 0) : 100000;
+    const unsigned short port = argc > 3 ? atoi(argv[3]) : 2345;
+
+    struct pdserv *pdserv = pdserv_create("startupbench", "1.0", gettime);
+    if (argc > 2)
+        pdserv_config_file(pdserv, argv[2]);
+
+    struct pdtask *task = pdserv_create_task(pdserv, 0.001, "Task1");
+
+    // Every 100th variable is a vector, every 1000th a matrix
+    static const size_t matrix[] = {20, 50};
+    std::vector<double> data(count * 10 + 1000);
+    double *addr = &data[0];
+
+    double t0 = now();
+    char path[200];
+    for (size_t i = 0; i < count; ++i) {
+        const char *markup = "";
+        size_t n = 1;
+        const size_t *dim = 0;
+
+        if (!(i % 1000)) {
+            n = 2;
+            dim = matrix;
+        }
+        else if (!(i % 100))
+            n = 10;
+
+        if (i & 1) {
+            if (!(i % 7))
+                markup = " <persistent=1>";
+            else if (!(i % 11))
+                markup = " <hide=p>";
+
+            ::snprintf(path, sizeof(path),
+                    "/Model/Subsystem%zu/Controller%zu/Block%zu/Gain%zu%s",
+                    i / 10000, i / 1000 % 10, i / 100 % 10, i % 100,
+                    markup);
+            pdserv_parameter(pdserv, path, 0666, pd_double_T,
+                    addr, n, dim, 0, 0);
+        }
+        else {
+            if (!(i % 13))
+                markup = " <hide>";
+
+            ::snprintf(path, sizeof(path),
+                    "/Model/Subsystem%zu/Controller%zu/Block%zu/Out%zu%s",
+                    i / 10000, i / 1000 % 10, i / 100 % 10, i % 100,
+                    markup);
+            pdserv_signal(task, 1, path, pd_double_T,
+                    addr, n, dim, 0, 0);
+        }
+
+        addr += dim ? 1000 : n;
+    }
+    double t1 = now();
+
+    if (pdserv_prepare(pdserv)) {
+        std::cerr << "pdserv_prepare() failed" << std::endl;
+        return 1;
+    }
+    double t2 = now();
+
+    // Keep the task running while waiting for the server
+    struct timespec time;
+    size_t cycles = 0;
+    while (!greeted(port)) {
+        gettime(&time);
+        pdserv_update(task, &time);
+        ::usleep(1000);
+
+        if (++cycles > 600000) {
+            std::cerr << "No greeting on port " << port << std::endl;
+            return 1;
+        }
+    }
+    double t3 = now();
+
+    std::cout << count << " variables: registration " << t1 - t0
+        << "s, pdserv_prepare() " << t2 - t1
+        << "s, server ready after " << t3 - t1 << "s" << std::endl;
+
+    pdserv_exit(pdserv);
+
+    return 0;
+}
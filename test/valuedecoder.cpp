@@ -0,0 +1,194 @@
+/*****************************************************************************
+ *
+ *  $Id$
+ *
+ *  Copyright 2010 Richard Hacker (lerichi at gmx dot net)
+ *
+ *  This file is part of the pdserv library.
+ *
+ *  The pdserv library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or (at
+ *  your option) any later version.
+ *
+ *  The pdserv library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with the pdserv library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "ValueDecoder.h"
+#include "DataType.h"
+
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <stdint.h>
+#include <assert.h>
+
+static bool parse(const char* s, double& value)
+{
+    return MsrProto::ValueDecoder::parseDouble(s, s + strlen(s), value);
+}
+
+// Decode text as CSV of nelem doubles, passing it to write() in pieces
+// of chunk characters
+static bool decodeCsv(MsrProto::ValueDecoder& decoder, const char* text,
+        size_t chunk, size_t nelem)
+{
+    size_t len = strlen(text);
+
+    decoder.reset(PdServ::DataType::float64, nelem,
+            MsrProto::ValueDecoder::Csv);
+    for (size_t i = 0; i < len; i += chunk)
+        decoder.write(text + i, std::min(chunk, len - i));
+
+    return decoder.finish();
+}
+
+int main()
+{
+    using PdServ::DataType;
+
+    // 64 bit integers above 2^53 must not be rounded through double
+    {
+        const uint64_t src[2] = { (1ULL << 60) + 1, 0xFFFFFFFFFFFFFFFFULL };
+        int64_t dst[2];
+        MsrProto::ValueDecoder::convert(DataType::uint64,
+                reinterpret_cast<const char*>(src),
+                DataType::int64, reinterpret_cast<char*>(dst), 2);
+        assert(dst[0] == int64_t((1ULL << 60) + 1));
+        assert(dst[1] == -1);
+    }
+
+    // Widening and narrowing integers
+    {
+        const int16_t src[3] = { -2, 300, 7 };
+        int64_t wide[3];
+        uint8_t narrow[3];
+        MsrProto::ValueDecoder::convert(DataType::int16,
+                reinterpret_cast<const char*>(src),
+                DataType::int64, reinterpret_cast<char*>(wide), 3);
+        assert(wide[0] == -2 and wide[1] == 300 and wide[2] == 7);
+
+        MsrProto::ValueDecoder::convert(DataType::int16,
+                reinterpret_cast<const char*>(src),
+                DataType::uint8, reinterpret_cast<char*>(narrow), 3);
+        assert(narrow[0] == 254 and narrow[1] == 44 and narrow[2] == 7);
+    }
+
+    // Floating point and unaligned source
+    {
+        char src[1 + 2 * sizeof(float)];
+        const float f[2] = { 1.5f, -3.0f };
+        std::memcpy(src + 1, f, sizeof(f));
+        double dst[2];
+        MsrProto::ValueDecoder::convert(DataType::float32, src + 1,
+                DataType::float64, reinterpret_cast<char*>(dst), 2);
+        assert(dst[0] == 1.5 and dst[1] == -3.0);
+    }
+
+    // Base64 of big endian uint64 into int64
+    {
+        MsrProto::ValueDecoder decoder;
+        decoder.reset(DataType::int64, 1, MsrProto::ValueDecoder::Base64,
+                &DataType::uint64, MsrProto::ValueDecoder::needsSwap("big"));
+        decoder.write("EAAAAAAAAAE=", 12);     // 0x1000000000000001
+        bool ok = decoder.finish();
+        assert(ok);
+        assert(decoder.size() == sizeof(int64_t));
+
+        int64_t v;
+        std::memcpy(&v, decoder.data(), sizeof(v));
+        assert(v == int64_t(0x1000000000000001LL));
+    }
+
+    // Numbers
+    {
+        double v;
+
+        assert(parse("42", v) and v == 42.0);
+        assert(parse("+42", v) and v == 42.0);
+        assert(parse("-42", v) and v == -42.0);
+        assert(parse("-0", v) and v == 0.0 and std::signbit(v));
+        assert(parse("000123.2500", v) and v == 123.25);
+        assert(parse(".5", v) and v == 0.5);
+        assert(parse("5.", v) and v == 5.0);
+        assert(parse("0.1", v) and v == 0.1);
+        assert(parse("-2.5e3", v) and v == -2500.0);
+        assert(parse("1E-3", v) and v == 0.001);
+
+        // Exponents at and just past the limit of exact powers of ten
+        assert(parse("1e22", v) and v == 1e22);
+        assert(parse("1e23", v) and v == 1e23);
+        assert(parse("3e-22", v) and v == 3e-22);
+        assert(parse("3e-23", v) and v == 3e-23);
+        assert(!parse("1e400", v));     // Out of range
+
+        // More than 15 significant digits
+        assert(parse("123456789012345678", v)
+                and v == 123456789012345678.0);
+        assert(parse("0.1234567890123456789", v)
+                and v == 0.1234567890123456789);
+        assert(parse("9007199254740993", v) and v == 9007199254740992.0);
+
+        assert(parse("inf", v) and std::isinf(v) and v > 0);
+        assert(parse("-Infinity", v) and std::isinf(v) and v < 0);
+        assert(parse("NaN", v) and std::isnan(v));
+
+        assert(!parse("", v));
+        assert(!parse("-", v));
+        assert(!parse(".", v));
+        assert(!parse("e5", v));
+        assert(!parse("1e", v));
+        assert(!parse("1e+", v));
+        assert(!parse("1x", v));
+        assert(!parse("1.2.3", v));
+        assert(!parse("--1", v));
+        assert(!parse("infi", v));
+        assert(!parse("nanx", v));
+    }
+
+    // CSV in pieces of every size, splitting numbers and separators
+    {
+        const char* text = " 1.5, -2e-3;300\t4 ,\r\n123456789012345678 ";
+        const double expect[5] = { 1.5, -2e-3, 300, 4, 123456789012345678.0 };
+
+        for (size_t chunk = 1; chunk <= strlen(text); ++chunk) {
+            MsrProto::ValueDecoder decoder;
+            bool ok = decodeCsv(decoder, text, chunk, 5);
+            assert(ok);
+            assert(decoder.size() == sizeof(expect));
+
+            double v[5];
+            std::memcpy(v, decoder.data(), sizeof(v));
+            for (size_t i = 0; i < 5; ++i)
+                assert(v[i] == expect[i]);
+        }
+    }
+
+    // CSV with more elements than required
+    {
+        MsrProto::ValueDecoder decoder;
+        bool ok = decodeCsv(decoder, "1,2,3,4,5", 3, 2);
+        assert(ok);
+        assert(decoder.size() == 2 * sizeof(double));
+
+        double v[2];
+        std::memcpy(v, decoder.data(), sizeof(v));
+        assert(v[0] == 1.0 and v[1] == 2.0);
+    }
+
+    // Malformed CSV
+    {
+        MsrProto::ValueDecoder decoder;
+        assert(!decodeCsv(decoder, "1,2x,3", 2, 3));
+        assert(!decodeCsv(decoder, "1,,2;abc", 4, 3));
+    }
+
+    return 0;
+}
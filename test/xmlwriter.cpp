@@ -22,22 +22,111 @@
  *****************************************************************************/
 
 #include "XmlElement.h"
-#include <cstdio>
+#include "XmlStream.h"
 
+#include <sstream>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <iostream>
-using std::cout;
-using std::cerr;
-using std::endl;
 
 using namespace MsrProto;
 
-int main(int /*argc*/, const char * /*argv*/[])
+/////////////////////////////////////////////////////////////////////////////
+// Sink that only counts the bytes written
+class NullBuf: public std::streambuf {
+    public:
+        NullBuf(): count(0) {}
+        size_t count;
+
+    private:
+        int overflow(int c) {
+            ++count;
+            return traits_type::not_eof(c);
+        }
+        std::streamsize xsputn(const char*, std::streamsize n) {
+            count += n;
+            return n;
+        }
+};
+
+/////////////////////////////////////////////////////////////////////////////
+static std::string write(bool compact, size_t bufsize)
 {
-    std::ostream os(cout.rdbuf());
+    std::stringbuf buf;
+    XmlStream os(&buf, bufsize);
+    os.compact = compact;
 
+    std::string id("a<b");
     {
-//        XmlElement a("hello", os);
-//        XmlElement("agein", a);
+        XmlElement data("data", os, 0, &id);
+        XmlElement::Attribute(data, "level") << 0;
+        XmlElement::Attribute(data, "n") << -12345L;
+        XmlElement::Attribute(data, "u") << 18446744073709551615ULL;
+        XmlElement::Attribute(data, "b") << true;
+
+        struct timespec ts = { 1234, 5006000 };
+        XmlElement::Attribute(data, "time") << ts;
+
+        XmlElement f(data.createChild("F"));
+        XmlElement::Attribute(f, "c") << 3u;
+        XmlElement::Attribute(f, "d").base64("Hello", 5);
+        XmlElement::Attribute(f, "h").hexDec("\x01\xfe", 2);
+        XmlElement::Attribute(f, "v") << 0.5;
+        XmlElement::Attribute(f, "s").setEscaped("&\"'>");
+    }
+
+    bool ok = os.flush();
+    assert(ok);
+    return buf.str();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+int main(int argc, const char *argv[])
+{
+    // Indented output, with a tiny buffer so that it has to be drained
+    // and grown several times
+    for (size_t bufsize = 1; bufsize < 64; bufsize *= 2)
+        assert(write(false, bufsize) ==
+                "<data level=\"0\" n=\"-12345\" u=\"18446744073709551615\""
+                " b=\"1\" time=\"1234.005006\" id=\"a&lt;b\">\r\n"
+                " <F c=\"3\" d=\"SGVsbG8=\" h=\"01FE\" v=\"0.5\""
+                " s=\"&amp;&quot;&apos;&gt;\"/>\r\n"
+                "</data>\r\n");
+
+    assert(write(true, 16384) ==
+            "<data level=\"0\" n=\"-12345\" u=\"18446744073709551615\""
+            " b=\"1\" time=\"1234.005006\" id=\"a&lt;b\">"
+            "<F c=\"3\" d=\"SGVsbG8=\" h=\"01FE\" v=\"0.5\""
+            " s=\"&amp;&quot;&apos;&gt;\"/>"
+            "</data>");
+
+    // Benchmark: tags per second, given as argument
+    //     xmlwriter <count>
+    if (argc > 1) {
+        size_t count = strtoul(argv[1], 0, 0);
+        NullBuf null;
+        XmlStream os(&null);
+        struct timespec ts = { 1234, 5006000 };
+        char data[64] = {0};
+
+        clock_t start = clock();
+        for (size_t i = 0; i < count; ++i) {
+            XmlElement e("data", os, 0, 0);
+            XmlElement::Attribute(e, "level") << 0;
+            XmlElement::Attribute(e, "time") << ts;
+
+            XmlElement f(e.createChild("F"));
+            XmlElement::Attribute(f, "c") << i;
+            XmlElement::Attribute(f, "d").base64(data, sizeof(data));
+        }
+        os.flush();
+        double t = double(clock() - start) / CLOCKS_PER_SEC;
+
+        std::cout << count << " tags in " << t << "s: "
+            << (t > 0 ? count / t : 0.0) << " tags/s, "
+            << null.count << " bytes" << std::endl;
     }
 
     return 0;